@@ -181,8 +181,6 @@ RAI_Tensor* RAI_TensorCreateFromOrtValue(OrtValue* v, size_t batch_offset, size_
     return NULL;
   }
 
-  ret = RedisModule_Calloc(1, sizeof(*ret));
-
   DLContext ctx = (DLContext){
       .device_type = kDLCPU,
       .device_id = 0
@@ -207,8 +205,9 @@ RAI_Tensor* RAI_TensorCreateFromOrtValue(OrtValue* v, size_t batch_offset, size_
 
     int64_t total_batch_size = dims[0];
 
-    shape = RedisModule_Calloc(ndims, sizeof(*shape));
-    strides = RedisModule_Calloc(ndims, sizeof(*strides));
+    ret = RAI_TensorNew(ndims);
+    shape = ret->tensor.dl_tensor.shape;
+    strides = ret->tensor.dl_tensor.strides;
     for (int64_t i=0; i<ndims; ++i)
     {
       shape[i] = dims[i];
@@ -241,7 +240,7 @@ RAI_Tensor* RAI_TensorCreateFromOrtValue(OrtValue* v, size_t batch_offset, size_
     const size_t sample_bytesize = total_bytesize / total_batch_size;
     const size_t batch_bytesize = sample_bytesize * batch_size;
 
-    char *data = RedisModule_Calloc(batch_bytesize, sizeof(*data));
+    char *data = RAI_TensorNewData(batch_bytesize, 0);
     memcpy(data, ort_data + batch_offset * sample_bytesize, batch_bytesize);
 #endif
 
@@ -250,37 +249,22 @@ RAI_Tensor* RAI_TensorCreateFromOrtValue(OrtValue* v, size_t batch_offset, size_
     // TODO: use manager_ctx to ensure ORT tensor doesn't get deallocated
     // This applies to outputs
 
-    ret->tensor = (DLManagedTensor){
-        .dl_tensor = (DLTensor){
-            .ctx = ctx,
+    ret->tensor.dl_tensor.ctx = ctx;
 #ifdef RAI_COPY_RUN_OUTPUT
-            .data = data,
+    ret->tensor.dl_tensor.data = data;
 #else
 #error zero-copy passing output memory from ORT not currently supported
 #endif
-            .ndim = ndims,
-            .dtype = dtype,
-            .shape = shape,
-            .strides = strides,
-            .byte_offset = 0},
-        .manager_ctx = NULL,
-        .deleter = NULL};
-
-    ret->refCount = 1;
+    ret->tensor.dl_tensor.dtype = dtype;
     return ret;
   }
 
 error:
   RAI_SetError(error, RAI_EMODELCREATE, ort->GetErrorMessage(status));
   ort->ReleaseStatus(status);
-  if (shape != NULL) {
-    RedisModule_Free(shape);
-  }
-  if (strides != NULL) {
-    RedisModule_Free(shape);
-  }
+  // shape and strides are allocated along with the tensor
   if (ret != NULL) {
-    RedisModule_Free(ret);
+    RAI_TensorFree(ret);
   }
   return NULL;
 }
@@ -292,6 +276,61 @@ typedef struct RAI_ONNXBuffer {
 
 OrtEnv* env = NULL;
 
+/**
+ * Reads the types and shapes of the inputs declared by a session. Inputs that
+ * are not tensors are left undeclared.
+ */
+static OrtStatus *RAI_OrtSessionInputSpecs(OrtSession *session, RAI_ModelInputSpec **specs) {
+  const OrtApi* ort = OrtGetApiBase()->GetApi(1);
+
+  size_t n_input_nodes;
+  OrtStatus *status = ort->SessionGetInputCount(session, &n_input_nodes);
+  if (status != NULL) {
+    return status;
+  }
+
+  *specs = array_new(RAI_ModelInputSpec, n_input_nodes);
+  for (size_t i = 0; i < n_input_nodes; i++) {
+    RAI_ModelInputSpec spec = { .dtype = { .bits = 0 }, .dims = NULL };
+
+    OrtTypeInfo *typeinfo;
+    status = ort->SessionGetInputTypeInfo(session, i, &typeinfo);
+    if (status != NULL) {
+      return status;
+    }
+
+    const OrtTensorTypeAndShapeInfo *info = NULL;
+    status = ort->CastTypeInfoToTensorInfo(typeinfo, &info);
+    if (status == NULL && info != NULL) {
+      ONNXTensorElementDataType type;
+      size_t ndims;
+      status = ort->GetTensorElementType(info, &type);
+      if (status == NULL) {
+        status = ort->GetDimensionsCount(info, &ndims);
+      }
+      if (status == NULL) {
+        int64_t dims[ndims + 1];
+        status = ort->GetDimensions(info, dims, ndims);
+        if (status == NULL) {
+          spec.dtype = RAI_GetDLDataTypeFromORT(type);
+          spec.dims = array_new(int64_t, ndims);
+          for (size_t j = 0; j < ndims; j++) {
+            // symbolic dimensions are reported as -1
+            spec.dims = array_append(spec.dims, dims[j]);
+          }
+        }
+      }
+    }
+    ort->ReleaseTypeInfo(typeinfo);
+    *specs = array_append(*specs, spec);
+    if (status != NULL) {
+      return status;
+    }
+  }
+
+  return NULL;
+}
+
 RAI_Model *RAI_ModelCreateORT(RAI_Backend backend, const char* devicestr, RAI_ModelOpts opts,
                               const char *modeldef, size_t modellen,
                               RAI_Error *error) {
@@ -327,7 +366,14 @@ RAI_Model *RAI_ModelCreateORT(RAI_Backend backend, const char* devicestr, RAI_Mo
     goto error;
   }
 
-  // status = ort->SetSessionThreadPoolSize(session_options, 1);
+  if (opts.backends_intra_op_parallelism > 0) {
+    status = ort->SetIntraOpNumThreads(session_options,
+                                       (int)opts.backends_intra_op_parallelism);
+  }
+  if (status == NULL && opts.backends_inter_op_parallelism > 0) {
+    status = ort->SetInterOpNumThreads(session_options,
+                                       (int)opts.backends_inter_op_parallelism);
+  }
   if (status != NULL) {
     ort->ReleaseSessionOptions(session_options);
     goto error;
@@ -362,6 +408,21 @@ RAI_Model *RAI_ModelCreateORT(RAI_Backend backend, const char* devicestr, RAI_Mo
     goto error;
   }
 
+  RAI_ModelInputSpec *input_specs = NULL;
+  status = RAI_OrtSessionInputSpecs(session, &input_specs);
+  if (status != NULL) {
+    if (input_specs) {
+      for (size_t i = 0; i < array_len(input_specs); i++) {
+        if (input_specs[i].dims) {
+          array_free(input_specs[i].dims);
+        }
+      }
+      array_free(input_specs);
+    }
+    ort->ReleaseSession(session);
+    goto error;
+  }
+
   // Since ONNXRuntime doesn't have a re-serialization function,
   // we cache the blob in order to re-serialize it.
   // Not optimal for storage purposes, but again, it may be temporary
@@ -380,6 +441,7 @@ RAI_Model *RAI_ModelCreateORT(RAI_Backend backend, const char* devicestr, RAI_Mo
   ret->refCount = 1;
   ret->opts = opts;
   ret->data = onnxbuffer;
+  ret->input_specs = input_specs;
 
   return ret;
 
@@ -401,6 +463,16 @@ void RAI_ModelFreeORT(RAI_Model* model, RAI_Error* error) {
   model->session = NULL;
 }
 
+/* Aborts a run past its MAXRUNTIME: ORT checks the terminate flag of the run
+ * options between the nodes of the graph. */
+static void RAI_ORTTerminateRun(void *arg) {
+  const OrtApi* ort = OrtGetApiBase()->GetApi(1);
+  OrtStatus *status = ort->RunOptionsSetTerminate((OrtRunOptions *)arg);
+  if (status) {
+    ort->ReleaseStatus(status);
+  }
+}
+
 int RAI_ModelRunORT(RAI_ModelRunCtx **mctxs, RAI_Error *error)
 {
   const OrtApi* ort = OrtGetApiBase()->GetApi(1);
@@ -530,27 +602,55 @@ int RAI_ModelRunORT(RAI_ModelRunCtx **mctxs, RAI_Error *error)
     //                _In_ const char* const* input_names, _In_ const OrtValue* const* input, size_t input_len,
     //                _In_ const char* const* output_names, size_t output_names_len, _Out_ OrtValue** output);
     OrtRunOptions *run_options = NULL;
+    RAI_RunCancel *cancel = mctxs[0]->cancel;
+    if (cancel) {
+      status = ort->CreateRunOptions(&run_options);
+      if (status != NULL) {
+        goto error;
+      }
+      RAI_RunCancelArm(cancel, RAI_ORTTerminateRun, run_options);
+    }
     status = ort->Run(session, run_options, input_names, (const OrtValue *const *)inputs,
                      n_input_nodes, output_names, n_output_nodes, outputs);
+    if (cancel) {
+      const int expired = RAI_RunCancelDisarm(cancel);
+      ort->ReleaseRunOptions(run_options);
+      if (status && expired) {
+        ort->ReleaseStatus(status);
+        for (size_t i = 0; i < n_input_nodes; i++) {
+          ort->ReleaseValue(inputs[i]);
+        }
+        RAI_SetError(error, RAI_ETIMEDOUT, "ERR Model run exceeded MAXRUNTIME");
+        return 1;
+      }
+    }
 
     if (status) {
       goto error;
     }
 
+    // the output is copied out of ORT once, and each run gets a view of
+    // its slice
+    const size_t total_batch_size = batch_offsets[nbatches-1] + batch_sizes[nbatches-1];
     for (size_t i = 0; i < n_output_nodes; i++) {
-      for (size_t b=0; b<nbatches; b++) {
-        RAI_Tensor* output_tensor = RAI_TensorCreateFromOrtValue(outputs[i], batch_offsets[b], batch_sizes[b], error);
-        if (error->code != RAI_OK) {
-          ort->ReleaseStatus(status);
-          return 1;
-        }
-        if (output_tensor) {
-          mctxs[b]->outputs[i].tensor = RAI_TensorGetShallowCopy(output_tensor);
-          RAI_TensorFree(output_tensor);
-        }
-        else {
-          printf("ERR: non-tensor output from ONNX models, ignoring (currently unsupported)");
+      RAI_Tensor* output_tensor = RAI_TensorCreateFromOrtValue(outputs[i], 0, total_batch_size, error);
+      if (error->code != RAI_OK) {
+        ort->ReleaseStatus(status);
+        return 1;
+      }
+      if (output_tensor) {
+        for (size_t b=0; b<nbatches; b++) {
+          if (nbatches > 1) {
+            mctxs[b]->outputs[i].tensor = RAI_TensorCreateBySlicingTensor(output_tensor, batch_offsets[b], batch_sizes[b]);
+          }
+          else {
+            mctxs[b]->outputs[i].tensor = RAI_TensorGetShallowCopy(output_tensor);
+          }
         }
+        RAI_TensorFree(output_tensor);
+      }
+      else {
+        printf("ERR: non-tensor output from ONNX models, ignoring (currently unsupported)");
       }
 
       ort->ReleaseValue(outputs[i]);
@@ -80,8 +80,6 @@ DLDataType RAI_GetDLDataTypeFromTF(TF_DataType dtype) {
 }
 
 RAI_Tensor* RAI_TensorCreateFromTFTensor(TF_Tensor *tensor, size_t batch_offset, size_t batch_size) {
-  RAI_Tensor* ret = RedisModule_Calloc(1, sizeof(*ret));
-
   DLContext ctx = (DLContext){
       .device_type = kDLCPU,
       .device_id = 0
@@ -91,8 +89,9 @@ RAI_Tensor* RAI_TensorCreateFromTFTensor(TF_Tensor *tensor, size_t batch_offset,
 
   const int64_t total_batch_size = TF_Dim(tensor, 0);
 
-  int64_t* shape = RedisModule_Calloc(ndims, sizeof(*shape));
-  int64_t* strides = RedisModule_Calloc(ndims, sizeof(*strides));
+  RAI_Tensor* ret = RAI_TensorNew(ndims);
+  int64_t* shape = ret->tensor.dl_tensor.shape;
+  int64_t* strides = ret->tensor.dl_tensor.strides;
   for (int64_t i = 0 ; i < ndims ; ++i) {
     shape[i] = TF_Dim(tensor, i);
     strides[i] = 1;
@@ -111,32 +110,20 @@ RAI_Tensor* RAI_TensorCreateFromTFTensor(TF_Tensor *tensor, size_t batch_offset,
   // Note: on YOLO this has no impact on perf
 #ifdef RAI_COPY_RUN_OUTPUT
   const size_t len = sample_bytesize * batch_size;
-  char* data = RedisModule_Calloc(len, sizeof(*data));
+  char* data = RAI_TensorNewData(len, 0);
   memcpy(data, TF_TensorData(tensor) + sample_bytesize * batch_offset, len);
 #endif
 
   // TODO: use manager_ctx to ensure TF tensor doesn't get deallocated
   // This applies to outputs
 
-  ret->tensor = (DLManagedTensor){
-    .dl_tensor = (DLTensor){
-      .ctx = ctx,
+  ret->tensor.dl_tensor.ctx = ctx;
 #ifdef RAI_COPY_RUN_OUTPUT
-      .data = data,
+  ret->tensor.dl_tensor.data = data;
 #else
-      .data = TF_TensorData(tensor),
+  ret->tensor.dl_tensor.data = TF_TensorData(tensor);
 #endif
-      .ndim = ndims,
-      .dtype = RAI_GetDLDataTypeFromTF(TF_TensorType(tensor)),
-      .shape = shape,
-      .strides = strides,
-      .byte_offset = 0
-    },
-    .manager_ctx = NULL,
-    .deleter = NULL
-  };
-
-  ret->refCount = 1;
+  ret->tensor.dl_tensor.dtype = RAI_GetDLDataTypeFromTF(TF_TensorType(tensor));
   return ret;
 }
 
@@ -389,6 +376,29 @@ RAI_Model *RAI_ModelCreateTF(RAI_Backend backend, const char* devicestr, RAI_Mod
     array_append(inputs_, RedisModule_Strdup(inputs[i]));
   }
 
+  // Placeholders carry the type of the input, and its shape unless they were
+  // created without one
+  RAI_ModelInputSpec *input_specs = array_new(RAI_ModelInputSpec, ninputs);
+  TF_Status *shapeStatus = TF_NewStatus();
+  for (size_t i=0; i<ninputs; ++i) {
+    TF_Output port = {.oper = TF_GraphOperationByName(model, inputs[i]), .index = 0};
+    RAI_ModelInputSpec spec = {.dtype = RAI_GetDLDataTypeFromTF(TF_OperationOutputType(port)),
+                               .dims = NULL};
+    const int ndims = TF_GraphGetTensorNumDims(model, port, shapeStatus);
+    if (TF_GetCode(shapeStatus) == TF_OK && ndims >= 0) {
+      int64_t dims[ndims + 1];
+      TF_GraphGetTensorShape(model, port, dims, ndims, shapeStatus);
+      if (TF_GetCode(shapeStatus) == TF_OK) {
+        spec.dims = array_new(int64_t, ndims);
+        for (int j=0; j<ndims; ++j) {
+          spec.dims = array_append(spec.dims, dims[j]);
+        }
+      }
+    }
+    input_specs = array_append(input_specs, spec);
+  }
+  TF_DeleteStatus(shapeStatus);
+
   char **outputs_ = array_new(char*, noutputs);
   for (long long i=0; i<noutputs; i++) {
     array_append(outputs_, RedisModule_Strdup(outputs[i]));
@@ -400,6 +410,7 @@ RAI_Model *RAI_ModelCreateTF(RAI_Backend backend, const char* devicestr, RAI_Mod
   ret->backend = backend;
   ret->devicestr = RedisModule_Strdup(devicestr);
   ret->inputs = inputs_;
+  ret->input_specs = input_specs;
   ret->outputs = outputs_;
   ret->opts = opts;
   ret->refCount = 1;
@@ -483,6 +494,11 @@ int RAI_ModelRunTF(RAI_ModelRunCtx** mctxs, RAI_Error *error) {
       batched_input_tensors[b] = mctxs[b]->inputs[i].tensor;
     }
     inputTensorsValues[i] = RAI_TFTensorFromTensors(batched_input_tensors, nbatches);
+    // TF_NewTensor copies data that is not aligned enough for its kernels
+    if (nbatches == 1 &&
+        TF_TensorData(inputTensorsValues[i]) != RAI_TensorData(batched_input_tensors[0])) {
+      mctxs[0]->fallback_copies++;
+    }
     TF_Output port;
     port.oper = TF_GraphOperationByName(mctxs[0]->model->model, mctxs[0]->inputs[i].name);
     port.index = 0;
@@ -502,17 +518,41 @@ int RAI_ModelRunTF(RAI_ModelRunCtx** mctxs, RAI_Error *error) {
     outputs[i] = port;
   }
 
-  TF_SessionRun(mctxs[0]->model->session, NULL /* run_options */,
+  // a RunOptions message with timeout_in_ms (field 2) set to MAXRUNTIME, so
+  // that TF cancels the run itself once it is exceeded
+  TF_Buffer *run_options = NULL;
+  if (mctxs[0]->model->opts.maxruntime > 0) {
+    uint8_t proto[11] = {0x10};
+    size_t len = 1;
+    unsigned long long timeout_ms = mctxs[0]->model->opts.maxruntime;
+    do {
+      proto[len++] = (timeout_ms & 0x7f) | (timeout_ms > 0x7f ? 0x80 : 0);
+      timeout_ms >>= 7;
+    } while (timeout_ms > 0);
+    run_options = TF_NewBufferFromString(proto, len);
+  }
+
+  TF_SessionRun(mctxs[0]->model->session, run_options,
                 inputs, inputTensorsValues, ninputs,
                 outputs, outputTensorsValues, noutputs,
                 NULL /* target_opers */, 0 /* ntargets */,
                 NULL /* run_Metadata */,
                 status);
 
+  if (run_options) {
+    TF_DeleteBuffer(run_options);
+  }
+
   for(size_t i = 0 ; i < ninputs ; ++i) {
     TF_DeleteTensor(inputTensorsValues[i]);
   }
 
+  if (TF_GetCode(status) == TF_DEADLINE_EXCEEDED) {
+    RAI_SetError(error, RAI_ETIMEDOUT, "ERR Model run exceeded MAXRUNTIME");
+    TF_DeleteStatus(status);
+    return 1;
+  }
+
   if (TF_GetCode(status) != TF_OK) {
     char* errorMessage = RedisModule_Strdup(TF_Message(status));
     RAI_SetError(error, RAI_EMODELRUN, errorMessage);
@@ -522,8 +562,17 @@ int RAI_ModelRunTF(RAI_ModelRunCtx** mctxs, RAI_Error *error) {
   }
 
   for(size_t i=0; i<noutputs; ++i) {
-    for (size_t b=0; b<nbatches; b++) {
-      mctxs[b]->outputs[i].tensor = RAI_TensorCreateFromTFTensor(outputTensorsValues[i], batch_offsets[b], batch_sizes[b]);
+    if (nbatches > 1) {
+      // copy the output out of TF once, and give each run a view of its slice
+      const size_t total_batch_size = batch_offsets[nbatches-1] + batch_sizes[nbatches-1];
+      RAI_Tensor* output_tensor = RAI_TensorCreateFromTFTensor(outputTensorsValues[i], 0, total_batch_size);
+      for (size_t b=0; b<nbatches; b++) {
+        mctxs[b]->outputs[i].tensor = RAI_TensorCreateBySlicingTensor(output_tensor, batch_offsets[b], batch_sizes[b]);
+      }
+      RAI_TensorFree(output_tensor);
+    }
+    else {
+      mctxs[0]->outputs[i].tensor = RAI_TensorCreateFromTFTensor(outputTensorsValues[i], 0, batch_sizes[0]);
     }
     TF_DeleteTensor(outputTensorsValues[i]);
   }
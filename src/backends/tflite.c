@@ -34,6 +34,8 @@ RAI_Model *RAI_ModelCreateTFLite(RAI_Backend backend, const char* devicestr, RAI
   switch (device) {
     case RAI_DEVICE_CPU:
       dl_device = kDLCPU;
+      // logical CPU devices are all the same host CPU to tflite
+      deviceid = -1;
       break;
     case RAI_DEVICE_GPU:
       dl_device = kDLGPU;
@@ -30,6 +30,8 @@ RAI_Model *RAI_ModelCreateTorch(RAI_Backend backend, const char* devicestr, RAI_
   switch (device) {
     case RAI_DEVICE_CPU:
       dl_device = kDLCPU;
+      // logical CPU devices are all the same host CPU to libtorch
+      deviceid = -1;
       break;
     case RAI_DEVICE_GPU:
       dl_device = kDLGPU;
@@ -121,6 +123,9 @@ int RAI_ModelRunTorch(RAI_ModelRunCtx** mctxs, RAI_Error *error) {
     outputs_dl[i] = NULL;
   }
 
+  torchSetNumThreads(mctxs[0]->model->opts.backends_intra_op_parallelism,
+                     mctxs[0]->model->opts.backends_inter_op_parallelism);
+
   char* error_descr = NULL;
   torchRunModel(mctxs[0]->model->model,
                 ninputs, inputs_dl, noutputs, outputs_dl,
@@ -183,6 +188,8 @@ RAI_Script *RAI_ScriptCreateTorch(const char* devicestr, const char *scriptdef,
   switch (device) {
     case RAI_DEVICE_CPU:
       dl_device = kDLCPU;
+      // logical CPU devices are all the same host CPU to libtorch
+      deviceid = -1;
       break;
     case RAI_DEVICE_GPU:
       dl_device = kDLGPU;
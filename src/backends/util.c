@@ -5,6 +5,12 @@ int parseDeviceStr(const char* devicestr, RAI_Device* device,
   if (strcasecmp(devicestr, "CPU") == 0) {
     *device = RAI_DEVICE_CPU;
     *deviceid = -1;
+  } else if (strncasecmp(devicestr, "CPU:", 4) == 0) {
+    *device = RAI_DEVICE_CPU;
+    if (sscanf(devicestr + 4, "%lld", (long long *)deviceid) != 1 ||
+        *deviceid < 0) {
+      return 0;
+    }
   } else if (strcasecmp(devicestr, "GPU") == 0) {
     *device = RAI_DEVICE_GPU;
     *deviceid = -1;
@@ -18,3 +24,52 @@ int parseDeviceStr(const char* devicestr, RAI_Device* device,
   return 1;
 }
 
+
+void RAI_RunCancelInit(RAI_RunCancel* cancel, long long deadline_us) {
+  pthread_mutex_init(&cancel->mutex, NULL);
+  cancel->deadline_us = deadline_us;
+  cancel->expired = 0;
+  cancel->abort = NULL;
+  cancel->arg = NULL;
+}
+
+void RAI_RunCancelDestroy(RAI_RunCancel* cancel) {
+  pthread_mutex_destroy(&cancel->mutex);
+}
+
+void RAI_RunCancelArm(RAI_RunCancel* cancel, void (*abort)(void*), void* arg) {
+  pthread_mutex_lock(&cancel->mutex);
+  cancel->abort = abort;
+  cancel->arg = arg;
+  if (cancel->expired) {
+    abort(arg);
+  }
+  pthread_mutex_unlock(&cancel->mutex);
+}
+
+int RAI_RunCancelDisarm(RAI_RunCancel* cancel) {
+  pthread_mutex_lock(&cancel->mutex);
+  cancel->abort = NULL;
+  cancel->arg = NULL;
+  const int expired = cancel->expired;
+  pthread_mutex_unlock(&cancel->mutex);
+  return expired;
+}
+
+void RAI_RunCancelExpire(RAI_RunCancel* cancel) {
+  pthread_mutex_lock(&cancel->mutex);
+  if (!cancel->expired) {
+    cancel->expired = 1;
+    if (cancel->abort) {
+      cancel->abort(cancel->arg);
+    }
+  }
+  pthread_mutex_unlock(&cancel->mutex);
+}
+
+int RAI_RunCancelExpired(RAI_RunCancel* cancel) {
+  pthread_mutex_lock(&cancel->mutex);
+  const int expired = cancel->expired;
+  pthread_mutex_unlock(&cancel->mutex);
+  return expired;
+}
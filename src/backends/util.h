@@ -1,13 +1,66 @@
 #ifndef SRC_BACKENDS_UTIL_H_
 #define SRC_BACKENDS_UTIL_H_
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <strings.h>
 
 #include "config.h"
 
+/**
+ * Parses a device string: CPU, CPU:<n>, GPU or GPU:<n>.
+ *
+ * CPU:<n> are logical CPU devices. They all run on the host, each with its own
+ * run queue whose workers can be pinned to a set of cores (see
+ * AI.CONFIG CPU_AFFINITY); backends should treat them as plain CPU.
+ *
+ * @param devicestr
+ * @param device output parameter for the device type
+ * @param deviceid output parameter for the device id, -1 if none was given
+ * @return 1 on success, 0 if the string is not a valid device
+ */
 int parseDeviceStr(const char* devicestr, RAI_Device* device,
                    int64_t* deviceid);
 
+/**
+ * Cancellation of a model run that exceeds the MAXRUNTIME of its model. The
+ * run watchdog expires it once `deadline_us` has passed. Backends able to
+ * abort a run in flight arm it, for the duration of the backend call, with a
+ * function that does: the function is called from the watchdog thread when
+ * the run expires, or right away if it expired already.
+ */
+typedef struct RAI_RunCancel {
+  pthread_mutex_t mutex;
+  long long deadline_us;
+  int expired;
+  void (*abort)(void* arg);
+  void* arg;
+} RAI_RunCancel;
+
+void RAI_RunCancelInit(RAI_RunCancel* cancel, long long deadline_us);
+
+void RAI_RunCancelDestroy(RAI_RunCancel* cancel);
+
+/**
+ * @param cancel
+ * @param abort function aborting the run, called with `arg`
+ * @param arg
+ */
+void RAI_RunCancelArm(RAI_RunCancel* cancel, void (*abort)(void*), void* arg);
+
+/**
+ * Disarms the cancellation once the backend call returned, after which the
+ * abort function is no longer called.
+ *
+ * @return 1 if the run expired, 0 otherwise
+ */
+int RAI_RunCancelDisarm(RAI_RunCancel* cancel);
+
+/* Expires the run and aborts it if the backend armed the cancellation. */
+void RAI_RunCancelExpire(RAI_RunCancel* cancel);
+
+/* @return 1 if the run expired, 0 otherwise */
+int RAI_RunCancelExpired(RAI_RunCancel* cancel);
+
 #endif /* SRC_BACKENDS_UTIL_H_ */
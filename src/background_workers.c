@@ -1,4 +1,8 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include "background_workers.h"
+#include "backends/util.h"
 #include "dag.h"
 #include "model_script_run_session.h"
 #include "model.h"
@@ -13,33 +17,915 @@
 #include "util/dict.h"
 #include "util/queue.h"
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define RUN_QUEUE_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define RUN_QUEUE_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define RUN_QUEUE_CPU_RELAX() sched_yield()
+#endif
+
+/**
+ * Scheduling order of the pending items: higher PRIORITY first, then earlier
+ * deadline, requests without TIMEOUT coming last, then order of arrival.
+ *
+ * @return a positive value if rinfo1 has to run before rinfo2, a negative
+ * value if after
+ */
+static int runInfoCompare(const RedisAI_RunInfo *rinfo1,
+                          const RedisAI_RunInfo *rinfo2) {
+  if (rinfo1->priority != rinfo2->priority) {
+    return rinfo1->priority > rinfo2->priority ? 1 : -1;
+  }
+  if (rinfo1->deadline_us != rinfo2->deadline_us) {
+    if (rinfo1->deadline_us == 0) {
+      return -1;
+    }
+    if (rinfo2->deadline_us == 0) {
+      return 1;
+    }
+    return rinfo1->deadline_us < rinfo2->deadline_us ? 1 : -1;
+  }
+  return rinfo1->queue_seq < rinfo2->queue_seq ? 1 : -1;
+}
+
+/* The priority queue keeps the greatest element on top */
+static int runInfoHeapCompare(void *a, void *b) {
+  return runInfoCompare(*(RedisAI_RunInfo **)a, *(RedisAI_RunInfo **)b);
+}
+
+static RunSubQueue *runSubQueueCreate(const int64_t *signature, uint64_t hash) {
+  RunSubQueue *sq = RedisModule_Calloc(1, sizeof(RunSubQueue));
+  if (signature) {
+    sq->signature = array_newlen(int64_t, array_len((int64_t *)signature));
+    memcpy(sq->signature, signature, array_len(sq->signature) * sizeof(int64_t));
+  }
+  sq->hash = hash;
+  sq->items = NewPriorityQueue(RedisAI_RunInfo *, 16, runInfoHeapCompare);
+  return sq;
+}
+
+static void runSubQueueFree(RunSubQueue *sq) {
+  if (sq->signature) {
+    array_free(sq->signature);
+  }
+  Priority_Queue_Free(sq->items);
+  RedisModule_Free(sq);
+}
+
+static inline size_t runSubQueueLength(RunSubQueue *sq) {
+  return Priority_Queue_Size(sq->items);
+}
+
+static inline RedisAI_RunInfo *runSubQueueFront(RunSubQueue *sq) {
+  RedisAI_RunInfo *rinfo = NULL;
+  Priority_Queue_Top(sq->items, &rinfo);
+  return rinfo;
+}
+
+static void runSubQueuePush(RunSubQueue *sq, RedisAI_RunInfo *rinfo) {
+  Priority_Queue_Push(sq->items, rinfo);
+  if (sq->signature) {
+    sq->nsamples += RAI_RunInfoBatchSize(rinfo);
+  }
+}
+
+static RedisAI_RunInfo *runSubQueuePop(RunSubQueue *sq) {
+  RedisAI_RunInfo *rinfo = runSubQueueFront(sq);
+  Priority_Queue_Pop(sq->items);
+  if (sq->signature) {
+    sq->nsamples -= RAI_RunInfoBatchSize(rinfo);
+  }
+  return rinfo;
+}
+
+/* Links a sub-queue at the head of the non-empty sub-queues. */
+static void runQueueLinkSubQueue(RunQueueInfo *run_queue_info, RunSubQueue *sq) {
+  sq->prev = NULL;
+  sq->next = run_queue_info->subqueues;
+  if (sq->next) {
+    sq->next->prev = sq;
+  }
+  run_queue_info->subqueues = sq;
+}
+
+static void runQueueUnlinkSubQueue(RunQueueInfo *run_queue_info,
+                                   RunSubQueue *sq) {
+  if (sq->prev) {
+    sq->prev->next = sq->next;
+  } else {
+    run_queue_info->subqueues = sq->next;
+  }
+  if (sq->next) {
+    sq->next->prev = sq->prev;
+  }
+  sq->prev = NULL;
+  sq->next = NULL;
+}
+
+static uint64_t runSubQueueHashCallback(const void *key) {
+  return ((const RunSubQueue *)key)->hash;
+}
+
+static int runSubQueueCompareCallback(void *privdata, const void *key1,
+                                      const void *key2) {
+  const int64_t *sig1 = ((const RunSubQueue *)key1)->signature;
+  const int64_t *sig2 = ((const RunSubQueue *)key2)->signature;
+  const uint32_t len = array_len((int64_t *)sig1);
+  return len == array_len((int64_t *)sig2) &&
+         memcmp(sig1, sig2, len * sizeof(int64_t)) == 0;
+}
+
+static AI_dictType runSubQueueDictType = {
+    .hashFunction = runSubQueueHashCallback,
+    .keyDup = NULL,
+    .valDup = NULL,
+    .keyCompare = runSubQueueCompareCallback,
+    .keyDestructor = NULL,
+    .valDestructor = NULL,
+};
+
+/* Requests in flight by blocked client, so that a disconnection can be
+ * mapped back to the request. Only ever touched by the main thread. */
+static AI_dict *blocked_clients = NULL;
+
+static uint64_t blockedClientHashCallback(const void *key) {
+  return AI_dictGenHashFunction(&key, sizeof(key));
+}
+
+static AI_dictType blockedClientDictType = {
+    .hashFunction = blockedClientHashCallback,
+    .keyDup = NULL,
+    .valDup = NULL,
+    .keyCompare = NULL,
+    .keyDestructor = NULL,
+    .valDestructor = NULL,
+};
+
+/* MODELRUN requests queued or running, by model and input tensors, so that
+ * identical requests arriving in the meantime can share their outcome. The
+ * input tensors are held by the requests, so a tensor cannot be freed and its
+ * address reused while the request is in flight: equal pointers mean equal
+ * inputs. The keys are a copy of those pointers, as workers swap the model
+ * and the inputs of a run context while it runs. Only ever touched by the
+ * main thread. */
+static AI_dict *inflight_runs = NULL;
+
+typedef struct InflightRunKey {
+  RAI_Model *model;
+  size_t noutputs;
+  size_t ninputs;
+  RAI_Tensor *inputs[];
+} InflightRunKey;
+
+static InflightRunKey *inflightRunKeyCreate(RAI_ModelRunCtx *mctx) {
+  const size_t ninputs = RAI_ModelRunCtxNumInputs(mctx);
+  InflightRunKey *key =
+      RedisModule_Alloc(sizeof(*key) + ninputs * sizeof(RAI_Tensor *));
+  key->model = mctx->model;
+  key->noutputs = RAI_ModelRunCtxNumOutputs(mctx);
+  key->ninputs = ninputs;
+  for (size_t i = 0; i < ninputs; i++) {
+    key->inputs[i] = mctx->inputs[i].tensor;
+  }
+  return key;
+}
+
+static uint64_t inflightRunHashCallback(const void *key) {
+  const InflightRunKey *k = key;
+  return AI_dictGenHashFunction(
+      k, sizeof(*k) + k->ninputs * sizeof(RAI_Tensor *));
+}
+
+static int inflightRunCompareCallback(void *privdata, const void *key1,
+                                      const void *key2) {
+  const InflightRunKey *k1 = key1;
+  const InflightRunKey *k2 = key2;
+  return k1->ninputs == k2->ninputs &&
+         memcmp(k1, k2, sizeof(*k1) + k1->ninputs * sizeof(RAI_Tensor *)) == 0;
+}
+
+static void inflightRunKeyDestructor(void *privdata, void *key) {
+  RedisModule_Free(key);
+}
+
+static AI_dictType inflightRunDictType = {
+    .hashFunction = inflightRunHashCallback,
+    .keyDup = NULL,
+    .valDup = NULL,
+    .keyCompare = inflightRunCompareCallback,
+    .keyDestructor = inflightRunKeyDestructor,
+    .valDestructor = NULL,
+};
+
+/**
+ * Attaches a MODELRUN to an identical request in flight, if there is one that
+ * serves it no later than the request would be served on its own: not with a
+ * lower priority, and not with a deadline before its own. Otherwise, the
+ * request is registered as in flight, for later ones to attach to.
+ *
+ * @return 1 if the request was attached and must not be queued, 0 otherwise
+ */
+static int runQueueCoalesce(RedisAI_RunInfo *rinfo) {
+  if (rinfo->use_local_context == 1 || rinfo->mctx == NULL ||
+      rinfo->client == NULL) {
+    return 0;
+  }
+  if (inflight_runs == NULL) {
+    inflight_runs = AI_dictCreate(&inflightRunDictType, NULL);
+  }
+
+  InflightRunKey *key = inflightRunKeyCreate(rinfo->mctx);
+  AI_dictEntry *entry = AI_dictFind(inflight_runs, key);
+  if (entry == NULL) {
+    AI_dictAdd(inflight_runs, key, rinfo);
+    return 0;
+  }
+  RedisModule_Free(key);
+
+  RedisAI_RunInfo *leader = AI_dictGetVal(entry);
+  if (atomic_load(&leader->cancelled) || leader->priority < rinfo->priority ||
+      (leader->deadline_us > 0 &&
+       (rinfo->deadline_us == 0 || leader->deadline_us < rinfo->deadline_us))) {
+    return 0;
+  }
+  if (leader->followers == NULL) {
+    leader->followers = array_new(RedisAI_RunInfo *, 1);
+  }
+  leader->followers = array_append(leader->followers, rinfo);
+  return 1;
+}
+
+void runQueueComplete(RedisAI_RunInfo *rinfo) {
+  if (inflight_runs != NULL && rinfo->mctx != NULL) {
+    // the run is over, its context is back to how it was queued
+    InflightRunKey *key = inflightRunKeyCreate(rinfo->mctx);
+    AI_dictEntry *entry = AI_dictFind(inflight_runs, key);
+    if (entry && AI_dictGetVal(entry) == rinfo) {
+      AI_dictDelete(inflight_runs, key);
+    }
+    RedisModule_Free(key);
+  }
+  if (rinfo->followers == NULL) {
+    return;
+  }
+
+  for (size_t f = 0; f < array_len(rinfo->followers); f++) {
+    RedisAI_RunInfo *follower = rinfo->followers[f];
+    follower->result = rinfo->result;
+    // the run is accounted for once, by the request that ran it
+    follower->duration_us = 0;
+    if (rinfo->result != REDISMODULE_OK) {
+      RAI_SetError(follower->err, rinfo->err->code, rinfo->err->detail);
+    }
+    for (size_t o = 0; o < RAI_ModelRunCtxNumOutputs(rinfo->mctx); o++) {
+      RAI_Tensor *t = RAI_ModelRunCtxOutputTensor(rinfo->mctx, o);
+      if (t) {
+        follower->mctx->outputs[o].tensor = RAI_TensorGetShallowCopy(t);
+      }
+    }
+    RedisModule_UnblockClient(follower->client, follower);
+  }
+  array_free(rinfo->followers);
+  rinfo->followers = NULL;
+}
+
+/* Weights set with AI.CONFIG WEIGHT, by tenant name. Main thread only. */
+static AI_dict *tenant_weights = NULL;
+
+/* WEIGHTs of the models and scripts in the keyspace, an array per tenant
+ * name. Main thread only. */
+static AI_dict *tenant_key_weights = NULL;
+
+const char *runQueueTenantName(const char *tag, const char *key) {
+  return tag && tag[0] != '\0' ? tag : key;
+}
+
+long long runQueueTenantWeight(const char *name) {
+  if (tenant_weights) {
+    AI_dictEntry *entry = AI_dictFind(tenant_weights, name);
+    if (entry) {
+      return (long long)(intptr_t)AI_dictGetVal(entry);
+    }
+  }
+  long long weight = 1;
+  if (tenant_key_weights) {
+    AI_dictEntry *entry = AI_dictFind(tenant_key_weights, name);
+    if (entry) {
+      long long *weights = AI_dictGetVal(entry);
+      for (size_t i = 0; i < array_len(weights); i++) {
+        if (weights[i] > weight) {
+          weight = weights[i];
+        }
+      }
+    }
+  }
+  return weight;
+}
+
+RunTenant *runQueueFindTenant(RunQueueInfo *run_queue_info, const char *name) {
+  AI_dictEntry *entry = AI_dictFind(run_queue_info->tenants, name);
+  return entry ? AI_dictGetVal(entry) : NULL;
+}
+
+/* Gives the tenant of that name in all the run queues its current weight. */
+static void runQueuesRefreshTenantWeight(const char *name) {
+  if (run_queues == NULL) {
+    return;
+  }
+  const long long weight = runQueueTenantWeight(name);
+  AI_dictIterator *iter = AI_dictGetIterator(run_queues);
+  AI_dictEntry *entry;
+  while ((entry = AI_dictNext(iter)) != NULL) {
+    RunTenant *tenant = runQueueFindTenant(AI_dictGetVal(entry), name);
+    if (tenant) {
+      atomic_store(&tenant->weight, weight);
+    }
+  }
+  AI_dictReleaseIterator(iter);
+}
+
+void setRunQueuesTenantWeight(const char *name, long long weight) {
+  if (tenant_weights == NULL) {
+    tenant_weights = AI_dictCreate(&AI_dictTypeHeapStrings, NULL);
+  }
+  if (weight <= 0) {
+    AI_dictDelete(tenant_weights, name);
+  } else {
+    AI_dictReplace(tenant_weights, (void *)name, (void *)(intptr_t)weight);
+  }
+  runQueuesRefreshTenantWeight(name);
+}
+
+void runQueuesAddTenantKey(const char *tag, const char *key, long long weight) {
+  if (tenant_key_weights == NULL) {
+    tenant_key_weights = AI_dictCreate(&AI_dictTypeHeapStrings, NULL);
+  }
+  const char *name = runQueueTenantName(tag, key);
+  if (name == NULL) {
+    return;
+  }
+  AI_dictEntry *entry = AI_dictFind(tenant_key_weights, name);
+  if (entry) {
+    long long *weights = AI_dictGetVal(entry);
+    weights = array_append(weights, weight);
+    AI_dictSetVal(tenant_key_weights, entry, weights);
+  } else {
+    long long *weights = array_new(long long, 1);
+    weights = array_append(weights, weight);
+    AI_dictAdd(tenant_key_weights, (void *)name, weights);
+  }
+  runQueuesRefreshTenantWeight(name);
+}
+
+void runQueuesRemoveTenantKey(const char *tag, const char *key,
+                              long long weight) {
+  const char *name = runQueueTenantName(tag, key);
+  if (name == NULL) {
+    return;
+  }
+  AI_dictEntry *entry =
+      tenant_key_weights ? AI_dictFind(tenant_key_weights, name) : NULL;
+  if (entry == NULL) {
+    return;
+  }
+  long long *weights = AI_dictGetVal(entry);
+  const size_t nweights = array_len(weights);
+  for (size_t i = 0; i < nweights; i++) {
+    if (weights[i] == weight) {
+      weights[i] = weights[nweights - 1];
+      array_trimm_len(weights, nweights - 1);
+      break;
+    }
+  }
+  if (array_len(weights) == 0) {
+    array_free(weights);
+    AI_dictDelete(tenant_key_weights, name);
+  }
+  runQueuesRefreshTenantWeight(name);
+}
+
+static void runTenantFree(RunTenant *tenant) {
+  if (tenant->unbatched) {
+    runSubQueueFree(tenant->unbatched);
+  }
+  RedisModule_Free(tenant->name);
+  RedisModule_Free(tenant);
+}
+
+/**
+ * Finds or creates the tenant of a request. A tenant created gets its weight
+ * from runQueueTenantWeight, which keeps it up to date afterwards.
+ * Main thread only.
+ */
+static RunTenant *runQueueTenant(RunQueueInfo *run_queue_info,
+                                 RedisAI_RunInfo *rinfo) {
+  const char *tag = "";
+  const char *key = "";
+  if (rinfo->use_local_context != 1) {
+    if (rinfo->runkey) {
+      key = RedisModule_StringPtrLen(rinfo->runkey, NULL);
+    }
+    if (rinfo->mctx) {
+      tag = rinfo->mctx->model->tag;
+    } else if (rinfo->sctx) {
+      tag = rinfo->sctx->script->tag;
+    }
+  }
+  const char *name = runQueueTenantName(tag, key);
+
+  RunTenant *tenant = runQueueFindTenant(run_queue_info, name);
+  if (tenant == NULL) {
+    tenant = RedisModule_Calloc(1, sizeof(RunTenant));
+    tenant->name = RedisModule_Strdup(name);
+    atomic_init(&tenant->weight, runQueueTenantWeight(name));
+    atomic_init(&tenant->deficit_us, 0);
+    atomic_init(&tenant->nruns, 0);
+    atomic_init(&tenant->wait_us, 0);
+    atomic_init(&tenant->max_wait_us, 0);
+    atomic_init(&tenant->run_us, 0);
+    AI_dictAdd(run_queue_info->tenants, (void *)name, tenant);
+  }
+  return tenant;
+}
+
+/* The run queues of the CPU devices, that share their workers with
+ * WORK_STEALING. Only appended to by the main thread, once a run queue is
+ * fully set up, and never removed from: the workers read the entries below
+ * the count they load. */
+static RunQueueInfo *cpu_run_queues[RUN_QUEUE_MAX_CPU_QUEUES];
+static atomic_int ncpu_run_queues = 0;
+
+/* Number of ready batches of a run queue that its own idle workers cannot
+ * take right away, negative if it has idle workers left. */
+static inline long long runQueueSurplus(RunQueueInfo *run_queue_info) {
+  return queueLength(run_queue_info->ready_queue) -
+         atomic_load(&run_queue_info->nidle);
+}
+
+/* Is the run queue of a CPU device loaded enough to form batches for the idle
+ * workers of the other CPU devices? */
+static int runQueueLendsWork(RunQueueInfo *run_queue_info) {
+  const long long threshold = atomic_load(&run_queue_info->steal_threshold);
+  return run_queue_info->cpu && threshold > 0 &&
+         atomic_load(&run_queue_info->npending) >= threshold;
+}
+
+/* Number of idle workers of the other CPU devices. */
+static long long runQueueIdleThieves(RunQueueInfo *run_queue_info) {
+  const int nqueues = atomic_load(&ncpu_run_queues);
+  long long nidle = 0;
+  for (int i = 0; i < nqueues; i++) {
+    if (cpu_run_queues[i] != run_queue_info) {
+      nidle += atomic_load(&cpu_run_queues[i]->nidle);
+    }
+  }
+  return nidle;
+}
+
+/* Can a worker of a CPU device take a batch off another CPU device? */
+static int runQueueCanSteal(RunQueueInfo *run_queue_info) {
+  if (!run_queue_info->cpu) {
+    return 0;
+  }
+  const int nqueues = atomic_load(&ncpu_run_queues);
+  for (int i = 0; i < nqueues; i++) {
+    RunQueueInfo *victim = cpu_run_queues[i];
+    if (victim != run_queue_info &&
+        atomic_load(&victim->steal_threshold) > 0 &&
+        runQueueSurplus(victim) > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Takes a batch that the workers of another CPU device cannot start right
+ * away off its ready queue, on behalf of an idle worker of a CPU device.
+ *
+ * @param run_queue_info run queue of the calling worker
+ * @param owner set to the run queue the batch was taken from
+ * @return the batch, or NULL if there is nothing to steal
+ */
+static RunBatch *runQueueSteal(RunQueueInfo *run_queue_info,
+                               RunQueueInfo **owner) {
+  if (!run_queue_info->cpu) {
+    return NULL;
+  }
+  const int nqueues = atomic_load(&ncpu_run_queues);
+  for (int i = 0; i < nqueues; i++) {
+    RunQueueInfo *victim = cpu_run_queues[i];
+    if (victim == run_queue_info ||
+        atomic_load(&victim->steal_threshold) == 0 ||
+        runQueueSurplus(victim) <= 0) {
+      continue;
+    }
+    RunBatch *batch = queuePop(victim->ready_queue);
+    if (batch) {
+      *owner = victim;
+      return batch;
+    }
+  }
+  return NULL;
+}
+
+int setRunQueueWorkStealing(RunQueueInfo *run_queue_info,
+                            long long min_pending) {
+  if (!run_queue_info->cpu || min_pending < 0) {
+    return REDISMODULE_ERR;
+  }
+  atomic_store(&run_queue_info->steal_threshold, min_pending);
+  return REDISMODULE_OK;
+}
+
+void setRunQueuesWorkStealing(long long min_pending) {
+  const int nqueues = atomic_load(&ncpu_run_queues);
+  for (int i = 0; i < nqueues; i++) {
+    setRunQueueWorkStealing(cpu_run_queues[i], min_pending);
+  }
+}
+
+void runQueueCancelClient(RedisModuleBlockedClient *bc) {
+  if (blocked_clients == NULL) {
+    return;
+  }
+  AI_dictEntry *entry = AI_dictFind(blocked_clients, bc);
+  if (entry) {
+    RedisAI_RunInfo *rinfo = AI_dictGetVal(entry);
+    // a run shared with other clients goes on for their sake
+    if (rinfo->followers == NULL) {
+      atomic_store(&rinfo->cancelled, 1);
+    }
+  }
+}
+
+void runQueueUntrack(RedisAI_RunInfo *rinfo) {
+  if (blocked_clients != NULL && rinfo->client != NULL) {
+    AI_dictDelete(blocked_clients, rinfo->client);
+  }
+}
+
+static void runQueueStageInit(RunQueueStage *stage) {
+  stage->started = 0;
+  pthread_mutex_init(&stage->mutex, NULL);
+  pthread_cond_init(&stage->condition_var, NULL);
+  atomic_init(&stage->parked, 0);
+  atomic_init(&stage->wakeup, 0);
+  atomic_init(&stage->stopping, 0);
+}
+
+/* Raises the wakeup flag of a stage, and wakes its thread up if it is parked.
+ * The store of the flag and the load of `parked` are both sequentially
+ * consistent, and so are the store of `parked` and the check of the flag in
+ * runQueueStageWait: either the thread sees the flag or we see the thread. */
+static void runQueueStageWake(RunQueueStage *stage) {
+  atomic_store(&stage->wakeup, 1);
+  if (atomic_load(&stage->parked)) {
+    pthread_mutex_lock(&stage->mutex);
+    pthread_cond_signal(&stage->condition_var);
+    pthread_mutex_unlock(&stage->mutex);
+  }
+}
+
+/**
+ * Blocks the thread of a stage until its wakeup flag is raised, polling for a
+ * short while before parking. The thread clears the flag before looking for
+ * work, so that nothing raised in the meantime is missed.
+ *
+ * @param stage
+ * @param deadline_us if positive, time at which the thread has to wake up
+ * anyway, e.g. to flush a partial batch
+ */
+static void runQueueStageWait(RunQueueStage *stage, long long deadline_us) {
+  for (int i = 0; i < RUN_QUEUE_SPIN_ITERATIONS; i++) {
+    if (atomic_load(&stage->wakeup)) {
+      return;
+    }
+    RUN_QUEUE_CPU_RELAX();
+  }
+
+  pthread_mutex_lock(&stage->mutex);
+  atomic_store(&stage->parked, 1);
+  while (!atomic_load(&stage->wakeup) && !atomic_load(&stage->stopping)) {
+    if (deadline_us > 0) {
+      struct timespec ts = {.tv_sec = deadline_us / 1000000,
+                            .tv_nsec = (deadline_us % 1000000) * 1000};
+      if (pthread_cond_timedwait(&stage->condition_var, &stage->mutex, &ts) ==
+          ETIMEDOUT) {
+        break;
+      }
+    } else {
+      pthread_cond_wait(&stage->condition_var, &stage->mutex);
+    }
+  }
+  atomic_store(&stage->parked, 0);
+  pthread_mutex_unlock(&stage->mutex);
+}
+
+/* Stops the thread of a stage, once it is done with what it is working on,
+ * and waits for it to exit. */
+static int runQueueStageStop(RunQueueStage *stage) {
+  if (!stage->started) {
+    return REDISMODULE_OK;
+  }
+  atomic_store(&stage->stopping, 1);
+  pthread_mutex_lock(&stage->mutex);
+  pthread_cond_signal(&stage->condition_var);
+  pthread_mutex_unlock(&stage->mutex);
+  stage->started = 0;
+  return pthread_join(stage->thread, NULL) == 0 ? REDISMODULE_OK
+                                                : REDISMODULE_ERR;
+}
+
+static void runQueueStageDestroy(RunQueueStage *stage) {
+  pthread_mutex_destroy(&stage->mutex);
+  pthread_cond_destroy(&stage->condition_var);
+}
+
 int freeRunQueueInfo(RunQueueInfo *info) {
   int result = REDISMODULE_OK;
-  if (info->run_queue) {
-    RedisModule_Free(info->run_queue);
+  /* Stop the stages in pipeline order, so that nothing is left in between */
+  if (runQueueStageStop(&info->batcher) != REDISMODULE_OK) {
+    result = REDISMODULE_ERR;
   }
   if (info->threads) {
-    /* Wait for workers to exit */
-    for (int i = 0; i < perqueueThreadPoolSize; i++) {
+    /* Retire all the workers and wait for them to exit */
+    pthread_mutex_lock(&info->park_mutex);
+    atomic_store(&info->nretire, array_len(info->threads));
+    pthread_cond_broadcast(&info->park_condition_var);
+    pthread_mutex_unlock(&info->park_mutex);
+    for (uint32_t i = 0; i < array_len(info->threads); i++) {
       const int rtn = pthread_join(info->threads[i], NULL);
       if (rtn != 0) {
         result = REDISMODULE_ERR;
       }
     }
     /* Now free pool structure */
-    RedisModule_Free(info->threads);
+    array_free(info->threads);
+    array_free(info->retired);
+  }
+  if (runQueueStageStop(&info->completer) != REDISMODULE_OK) {
+    result = REDISMODULE_ERR;
   }
+  if (info->cpus) {
+    array_free(info->cpus);
+  }
+  if (info->run_queue) {
+    queueRelease(info->run_queue);
+  }
+  if (info->ready_queue) {
+    queueRelease(info->ready_queue);
+  }
+  if (info->done_queue) {
+    queueRelease(info->done_queue);
+  }
+  if (info->batch_queues) {
+    AI_dictRelease(info->batch_queues);
+  }
+  RunSubQueue *sq = info->subqueues;
+  while (sq) {
+    RunSubQueue *next = sq->next;
+    /* the sub-queues without signature belong to their tenant */
+    if (sq->signature) {
+      runSubQueueFree(sq);
+    }
+    sq = next;
+  }
+  if (info->tenants) {
+    AI_dictIterator *iter = AI_dictGetIterator(info->tenants);
+    AI_dictEntry *entry;
+    while ((entry = AI_dictNext(iter)) != NULL) {
+      runTenantFree(AI_dictGetVal(entry));
+    }
+    AI_dictReleaseIterator(iter);
+    AI_dictRelease(info->tenants);
+  }
+  if (info->signature_buf) {
+    array_free(info->signature_buf);
+  }
+  runQueueStageDestroy(&info->batcher);
+  runQueueStageDestroy(&info->completer);
+  pthread_mutex_destroy(&info->park_mutex);
+  pthread_cond_destroy(&info->park_condition_var);
   RedisModule_Free(info);
   return result;
 }
 
 void *RedisAI_Run_ThreadMain(void *arg);
+void *RedisAI_Batcher_ThreadMain(void *arg);
+void *RedisAI_Complete_ThreadMain(void *arg);
+
+/**
+ * Parses a list of cores in the format of the kernel's cpulist files, e.g.
+ * "0-3,8,10-11".
+ *
+ * @return an array with the cores, or NULL if the list is invalid or empty
+ */
+static int *parseCPUList(const char *cpulist) {
+  int *cpus = array_new(int, 8);
+  const char *p = cpulist;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    const long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p || first < 0) {
+      break;
+    }
+    p = end;
+    if (*p == '-') {
+      const char *start = p + 1;
+      last = strtol(start, &end, 10);
+      if (end == start || last < first) {
+        break;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {
+      cpus = array_append(cpus, (int)cpu);
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0' && *p != '\n') {
+      break;
+    }
+  }
+  if ((*p != '\0' && *p != '\n') || array_len(cpus) == 0) {
+    array_free(cpus);
+    return NULL;
+  }
+  return cpus;
+}
+
+/**
+ * Default cores of a logical CPU device: CPU:<n> runs on the cores of NUMA
+ * node n, if the host has such a node.
+ *
+ * @return an array with the cores, or NULL if the workers are not pinned
+ */
+static int *runQueueDefaultAffinity(const char *devicestr) {
+  RAI_Device device;
+  int64_t deviceid;
+  if (!parseDeviceStr(devicestr, &device, &deviceid) ||
+      device != RAI_DEVICE_CPU || deviceid < 0) {
+    return NULL;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%lld/cpulist",
+           (long long)deviceid);
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return NULL;
+  }
+  char cpulist[1024];
+  int *cpus = NULL;
+  if (fgets(cpulist, sizeof(cpulist), f) != NULL) {
+    cpus = parseCPUList(cpulist);
+  }
+  fclose(f);
+  return cpus;
+}
+
+#ifdef __linux__
+static void cpuListToSet(const int *cpus, cpu_set_t *set) {
+  CPU_ZERO(set);
+  for (uint32_t i = 0; i < array_len((int *)cpus); i++) {
+    if (cpus[i] < CPU_SETSIZE) {
+      CPU_SET(cpus[i], set);
+    }
+  }
+}
+#endif
+
+int setRunQueueAffinity(RunQueueInfo *run_queue_info, const char *cpulist) {
+#ifdef __linux__
+  int *cpus = parseCPUList(cpulist);
+  if (cpus == NULL) {
+    return REDISMODULE_ERR;
+  }
+  cpu_set_t set;
+  cpuListToSet(cpus, &set);
+  for (uint32_t i = 0; i < array_len(run_queue_info->threads); i++) {
+    if (pthread_setaffinity_np(run_queue_info->threads[i], sizeof(set),
+                               &set) != 0) {
+      array_free(cpus);
+      return REDISMODULE_ERR;
+    }
+  }
+  RunQueueStage *stages[] = {&run_queue_info->batcher,
+                             &run_queue_info->completer};
+  for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+    if (stages[i]->started &&
+        pthread_setaffinity_np(stages[i]->thread, sizeof(set), &set) != 0) {
+      array_free(cpus);
+      return REDISMODULE_ERR;
+    }
+  }
+  if (run_queue_info->cpus) {
+    array_free(run_queue_info->cpus);
+  }
+  run_queue_info->cpus = cpus;
+  return REDISMODULE_OK;
+#else
+  return REDISMODULE_ERR;
+#endif
+}
+
+/* Starts a thread of the run queue, on its cores if it is pinned. */
+static int runQueueStartThread(RunQueueInfo *run_queue_info,
+                               void *(*start_routine)(void *),
+                               pthread_t *thread) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+#ifdef __linux__
+  if (run_queue_info->cpus) {
+    cpu_set_t set;
+    cpuListToSet(run_queue_info->cpus, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+  }
+#endif
+  const int rtn =
+      pthread_create(thread, &attr, start_routine, run_queue_info);
+  pthread_attr_destroy(&attr);
+  return rtn;
+}
+
+/* Joins the workers that retired since the last call. Main thread only. */
+static void runQueueJoinRetired(RunQueueInfo *run_queue_info) {
+  pthread_mutex_lock(&run_queue_info->park_mutex);
+  pthread_t *retired = run_queue_info->retired;
+  run_queue_info->retired = array_new(pthread_t, 1);
+  pthread_mutex_unlock(&run_queue_info->park_mutex);
+
+  for (uint32_t i = 0; i < array_len(retired); i++) {
+    pthread_join(retired[i], NULL);
+    const uint32_t nthreads = array_len(run_queue_info->threads);
+    for (uint32_t j = 0; j < nthreads; j++) {
+      if (pthread_equal(run_queue_info->threads[j], retired[i])) {
+        run_queue_info->threads[j] = run_queue_info->threads[nthreads - 1];
+        array_trimm_len(run_queue_info->threads, nthreads - 1);
+        break;
+      }
+    }
+  }
+  array_free(retired);
+}
+
+int resizeRunQueue(RunQueueInfo *run_queue_info, long long nworkers) {
+  if (nworkers < 1) {
+    return REDISMODULE_ERR;
+  }
+  runQueueJoinRetired(run_queue_info);
+
+  long long delta = nworkers - run_queue_info->nworkers;
+  pthread_mutex_lock(&run_queue_info->park_mutex);
+  const int nretire = atomic_load(&run_queue_info->nretire);
+  if (delta < 0) {
+    atomic_store(&run_queue_info->nretire, nretire - delta);
+    pthread_cond_broadcast(&run_queue_info->park_condition_var);
+  } else {
+    /* Workers that were asked to retire and haven't yet can stay */
+    const long long nkept = delta < nretire ? delta : nretire;
+    atomic_store(&run_queue_info->nretire, nretire - nkept);
+    delta -= nkept;
+  }
+  pthread_mutex_unlock(&run_queue_info->park_mutex);
+
+  for (long long i = 0; i < delta; i++) {
+    pthread_t thread;
+    if (runQueueStartThread(run_queue_info, RedisAI_Run_ThreadMain, &thread) !=
+        0) {
+      run_queue_info->nworkers = nworkers - delta + i;
+      return REDISMODULE_ERR;
+    }
+    run_queue_info->threads = array_append(run_queue_info->threads, thread);
+  }
+  run_queue_info->nworkers = nworkers;
+  return REDISMODULE_OK;
+}
+
+long long runQueuesWorkerCount(void) {
+  long long nworkers = 0;
+  if (run_queues == NULL) {
+    return nworkers;
+  }
+  AI_dictIterator *iter = AI_dictGetSafeIterator(run_queues);
+  AI_dictEntry *entry = AI_dictNext(iter);
+  while (entry) {
+    RunQueueInfo *run_queue_info = AI_dictGetVal(entry);
+    nworkers += run_queue_info->nworkers;
+    entry = AI_dictNext(iter);
+  }
+  AI_dictReleaseIterator(iter);
+  return nworkers;
+}
 
 /* Ensure that the the run queue for the device exists.
  * If not, create it. */
@@ -54,144 +940,842 @@ int ensureRunQueue(const char *devicestr, RunQueueInfo **run_queue_info) {
     *run_queue_info = AI_dictGetVal(entry);
     result = REDISMODULE_OK;
   } else {
-    *run_queue_info = RedisModule_Alloc(sizeof(RunQueueInfo));
-    (*run_queue_info)->run_queue = queueCreate();
-    pthread_cond_init(&(*run_queue_info)->queue_condition_var, NULL);
-    pthread_mutex_init(&(*run_queue_info)->run_queue_mutex, NULL);
-    (*run_queue_info)->threads = (pthread_t *)RedisModule_Alloc(
-        sizeof(pthread_t) * perqueueThreadPoolSize);
-    /* create threads */
-    for (int i = 0; i < perqueueThreadPoolSize; i++) {
-      if (pthread_create(&((*run_queue_info)->threads[i]), NULL,
-                         RedisAI_Run_ThreadMain, *run_queue_info) != 0) {
-        freeRunQueueInfo(*run_queue_info);
-        return REDISMODULE_ERR;
+    *run_queue_info = RedisModule_Calloc(1, sizeof(RunQueueInfo));
+    (*run_queue_info)->run_queue = queueCreate(RUN_QUEUE_CAPACITY);
+    (*run_queue_info)->ready_queue = queueCreate(RUN_QUEUE_CAPACITY);
+    (*run_queue_info)->done_queue = queueCreate(RUN_QUEUE_CAPACITY);
+    if ((*run_queue_info)->run_queue == NULL ||
+        (*run_queue_info)->ready_queue == NULL ||
+        (*run_queue_info)->done_queue == NULL) {
+      if ((*run_queue_info)->run_queue) {
+        queueRelease((*run_queue_info)->run_queue);
+      }
+      if ((*run_queue_info)->ready_queue) {
+        queueRelease((*run_queue_info)->ready_queue);
+      }
+      if ((*run_queue_info)->done_queue) {
+        queueRelease((*run_queue_info)->done_queue);
       }
+      RedisModule_Free(*run_queue_info);
+      return REDISMODULE_ERR;
     }
+    (*run_queue_info)->subqueues = NULL;
+    (*run_queue_info)->tenants = AI_dictCreate(&AI_dictTypeHeapStrings, NULL);
+    (*run_queue_info)->drr_current = NULL;
+    (*run_queue_info)->drr_epoch = 0;
+    (*run_queue_info)->batch_queues =
+        AI_dictCreate(&runSubQueueDictType, NULL);
+    (*run_queue_info)->signature_buf = array_new(int64_t, 16);
+    (*run_queue_info)->next_seq = 0;
+    runQueueStageInit(&(*run_queue_info)->batcher);
+    runQueueStageInit(&(*run_queue_info)->completer);
+    pthread_mutex_init(&(*run_queue_info)->park_mutex, NULL);
+    pthread_cond_init(&(*run_queue_info)->park_condition_var, NULL);
+    atomic_init(&(*run_queue_info)->parked, 0);
+    atomic_init(&(*run_queue_info)->nidle, 0);
+    RAI_Device device;
+    int64_t deviceid;
+    (*run_queue_info)->cpu =
+        parseDeviceStr(devicestr, &device, &deviceid) &&
+        device == RAI_DEVICE_CPU &&
+        atomic_load(&ncpu_run_queues) < RUN_QUEUE_MAX_CPU_QUEUES;
+    atomic_init(&(*run_queue_info)->steal_threshold,
+                (*run_queue_info)->cpu ? getRunQueueStealThreshold() : 0);
+    atomic_init(&(*run_queue_info)->npending, 0);
+    atomic_init(&(*run_queue_info)->item_us, 0);
+    (*run_queue_info)->threads = array_new(pthread_t, perqueueThreadPoolSize);
+    (*run_queue_info)->retired = array_new(pthread_t, 1);
+    atomic_init(&(*run_queue_info)->nretire, 0);
+    (*run_queue_info)->nworkers = 0;
+    (*run_queue_info)->cpus = runQueueDefaultAffinity(devicestr);
+    /* create threads */
+    if (runQueueStartThread(*run_queue_info, RedisAI_Complete_ThreadMain,
+                            &(*run_queue_info)->completer.thread) != 0) {
+      freeRunQueueInfo(*run_queue_info);
+      return REDISMODULE_ERR;
+    }
+    (*run_queue_info)->completer.started = 1;
+    if (resizeRunQueue(*run_queue_info, perqueueThreadPoolSize) !=
+        REDISMODULE_OK) {
+      freeRunQueueInfo(*run_queue_info);
+      return REDISMODULE_ERR;
+    }
+    if (runQueueStartThread(*run_queue_info, RedisAI_Batcher_ThreadMain,
+                            &(*run_queue_info)->batcher.thread) != 0) {
+      freeRunQueueInfo(*run_queue_info);
+      return REDISMODULE_ERR;
+    }
+    (*run_queue_info)->batcher.started = 1;
     AI_dictAdd(run_queues, (void *)devicestr, (void *)*run_queue_info);
+    if ((*run_queue_info)->cpu) {
+      const int nqueues = atomic_load(&ncpu_run_queues);
+      cpu_run_queues[nqueues] = *run_queue_info;
+      atomic_store(&ncpu_run_queues, nqueues + 1);
+    }
     result = REDISMODULE_OK;
   }
 
   return result;
 }
 
-void *RedisAI_Run_ThreadMain(void *arg) {
-  RunQueueInfo *run_queue_info = (RunQueueInfo *)arg;
-  pthread_t self = pthread_self();
-#ifdef __APPLE__
-  int res = pthread_setname_np("redisai_bthread");
-#else
-  int res = pthread_setname_np(self, "redisai_bthread");
-#endif
-  pthread_mutex_lock(&run_queue_info->run_queue_mutex);
-  while (true) {
-    int rc = pthread_cond_wait(&run_queue_info->queue_condition_var,
-                               &run_queue_info->run_queue_mutex);
+static int runQueueIsFull(RunQueueInfo *run_queue_info) {
+  return queueLength(run_queue_info->run_queue) >=
+         (long long)queueCapacity(run_queue_info->run_queue);
+}
 
-    long long run_queue_len = queueLength(run_queue_info->run_queue);
+/* Expected time before a new request starts running, assuming the workers
+ * share the pending requests evenly. */
+static long long runQueueEstimatedWait(RunQueueInfo *run_queue_info) {
+  const long long npending = atomic_load(&run_queue_info->npending);
+  const long long item_us = atomic_load(&run_queue_info->item_us);
+  return npending * item_us / run_queue_info->nworkers;
+}
 
-    while (run_queue_len > 0) {
-      queueItem **evicted_items = NULL;
-      RedisAI_RunInfo **batch_rinfo = NULL;
+int runQueueAdmit(RunQueueInfo *run_queue_info, RAI_Error *err) {
+  const long long max_length = getRunQueueMaxLength();
+  if (runQueueIsFull(run_queue_info) ||
+      (max_length > 0 &&
+       atomic_load(&run_queue_info->npending) >= max_length)) {
+    RAI_SetError(err, RAI_EBUSY, "BUSY Run queue is full for device");
+    return REDISMODULE_ERR;
+  }
+  const long long max_wait_ms = getRunQueueMaxWait();
+  if (max_wait_ms > 0 &&
+      runQueueEstimatedWait(run_queue_info) > max_wait_ms * 1000) {
+    RAI_SetError(err, RAI_EBUSY,
+                 "BUSY Estimated wait in the run queue exceeds MAX_QUEUE_WAIT");
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
 
-      queueItem *item = queueFront(run_queue_info->run_queue);
+/* Folds the run time per request of the last batch into `item_us`. Workers
+ * may race on the update, losing a sample at worst. */
+static void runQueueUpdateItemTime(RunQueueInfo *run_queue_info,
+                                   long long item_us) {
+  const long long avg_us = atomic_load(&run_queue_info->item_us);
+  if (avg_us == 0) {
+    atomic_store(&run_queue_info->item_us, item_us);
+  } else {
+    atomic_store(&run_queue_info->item_us,
+                 avg_us + ((item_us - avg_us) >> RUN_QUEUE_ITEM_TIME_SHIFT));
+  }
+}
 
-      while (item) {
-        RedisAI_RunInfo *rinfo = (RedisAI_RunInfo *)item->value;
+/* Wakes up one parked worker, if any. */
+static void runQueueWakeWorker(RunQueueInfo *run_queue_info) {
+  if (atomic_load(&run_queue_info->parked) > 0) {
+    pthread_mutex_lock(&run_queue_info->park_mutex);
+    pthread_cond_signal(&run_queue_info->park_condition_var);
+    pthread_mutex_unlock(&run_queue_info->park_mutex);
+  }
+}
 
-        if (evicted_items) {
-          array_free(evicted_items);
-          array_free(batch_rinfo);
-        }
-        evicted_items = array_new(queueItem *, run_queue_len);
-        batch_rinfo = array_new(RedisAI_RunInfo *, run_queue_len);
+/**
+ * Splits a MODELRUN larger than its model's batchsize into batchsize-sized
+ * chunks, that workers can run in parallel, provided the run queue has room
+ * for all of them. Main thread only: the main thread being the only producer,
+ * the room can only grow until the chunks are pushed.
+ *
+ * @return 1 if the request was split, 0 if it runs whole
+ */
+static int runQueueSplit(RunQueueInfo *run_queue_info, RedisAI_RunInfo *rinfo) {
+  if (rinfo->use_local_context == 1 || rinfo->mctx == NULL) {
+    return 0;
+  }
+  const size_t batchsize = rinfo->mctx->model->opts.batchsize;
+  const size_t current_batchsize = RAI_RunInfoBatchSize(rinfo);
+  if (batchsize == 0 || current_batchsize <= batchsize) {
+    return 0;
+  }
+  const long long nchunks = (current_batchsize + batchsize - 1) / batchsize;
+  if (queueCapacity(run_queue_info->run_queue) -
+          queueLength(run_queue_info->run_queue) <
+      nchunks) {
+    return 0;
+  }
+  return RAI_RunInfoSplit(rinfo, batchsize) == REDISMODULE_OK;
+}
 
-        array_append(evicted_items, item);
-        array_append(batch_rinfo, rinfo);
+int runQueuePush(RunQueueInfo *run_queue_info, RedisAI_RunInfo *rinfo) {
+  rinfo->enqueue_us = ustime();
+  if (rinfo->client != NULL) {
+    if (blocked_clients == NULL) {
+      blocked_clients = AI_dictCreate(&blockedClientDictType, NULL);
+    }
+    AI_dictAdd(blocked_clients, rinfo->client, rinfo);
+  }
+  if (runQueueCoalesce(rinfo)) {
+    return REDISMODULE_OK;
+  }
+  rinfo->tenant = runQueueTenant(run_queue_info, rinfo);
+  if (runQueueSplit(run_queue_info, rinfo)) {
+    const long long nchunks = array_len(rinfo->chunks);
+    atomic_fetch_add(&run_queue_info->npending, nchunks);
+    for (long long i = 0; i < nchunks; i++) {
+      queuePush(run_queue_info->run_queue, rinfo->chunks[i]);
+    }
+  } else {
+    atomic_fetch_add(&run_queue_info->npending, 1);
+    if (!queuePush(run_queue_info->run_queue, rinfo)) {
+      atomic_fetch_sub(&run_queue_info->npending, 1);
+      runQueueComplete(rinfo);
+      runQueueUntrack(rinfo);
+      return REDISMODULE_ERR;
+    }
+  }
+  runQueueStageWake(&run_queue_info->batcher);
+  return REDISMODULE_OK;
+}
 
-        if (rinfo->sctx) {
-          break;
-        }
+/**
+ * Blocks the calling worker until a batch is pushed onto the ready queue, or
+ * until there is a batch to steal from another CPU device.
+ * The worker first polls the queue for a short while, so that bursts of
+ * requests don't pay for a futex wakeup each, and then parks.
+ *
+ * The push of the batcher and its load of `parked` are both sequentially
+ * consistent, and so are the increment of `parked` and the emptiness check
+ * here: either the worker sees the batch or the batcher sees the worker.
+ */
+static void runQueueWait(RunQueueInfo *run_queue_info) {
+  for (int i = 0; i < RUN_QUEUE_SPIN_ITERATIONS; i++) {
+    if (queueLength(run_queue_info->ready_queue) > 0 ||
+        runQueueCanSteal(run_queue_info)) {
+      return;
+    }
+    RUN_QUEUE_CPU_RELAX();
+  }
 
-        // DAGRUN
-        if (rinfo->use_local_context==1){
-          break;
-        }
+  pthread_mutex_lock(&run_queue_info->park_mutex);
+  atomic_fetch_add(&run_queue_info->parked, 1);
+  while (queueLength(run_queue_info->ready_queue) == 0 &&
+         !runQueueCanSteal(run_queue_info) &&
+         atomic_load(&run_queue_info->nretire) == 0) {
+    pthread_cond_wait(&run_queue_info->park_condition_var,
+                      &run_queue_info->park_mutex);
+  }
+  atomic_fetch_sub(&run_queue_info->parked, 1);
+  pthread_mutex_unlock(&run_queue_info->park_mutex);
+}
 
-        size_t batchsize = rinfo->mctx->model->opts.batchsize;
+/**
+ * Computes the batching signature of a MODELRUN request into the run queue
+ * signature buffer: the model and the tenant, followed by type and shape past
+ * the batch dimension of every input. Requests with equal signatures can be batched
+ * together (see RAI_RunInfoBatchable).
+ *
+ * @return the signature, or NULL if the request has to run alone
+ */
+static int64_t *runQueueSignature(RunQueueInfo *run_queue_info,
+                                  RedisAI_RunInfo *rinfo) {
+  if (rinfo->use_local_context == 1 || rinfo->mctx == NULL) {
+    return NULL;
+  }
 
-        if (batchsize == 0) {
-          break;
-        }
+  const size_t batchsize = rinfo->mctx->model->opts.batchsize;
+  if (batchsize == 0) {
+    return NULL;
+  }
 
-        size_t current_batchsize = RAI_RunInfoBatchSize(rinfo);
+  const size_t current_batchsize = RAI_RunInfoBatchSize(rinfo);
+  if (current_batchsize == 0 || current_batchsize >= batchsize) {
+    return NULL;
+  }
 
-        if (current_batchsize == 0 || current_batchsize >= batchsize) {
-          break;
-        }
+  int64_t *sig = array_trimm_len(run_queue_info->signature_buf, 0);
+  const size_t ninputs = RAI_ModelRunCtxNumInputs(rinfo->mctx);
+  sig = array_append(sig, (int64_t)(intptr_t)rinfo->mctx->model);
+  sig = array_append(sig, (int64_t)(intptr_t)rinfo->tenant);
+  sig = array_append(sig, (int64_t)ninputs);
+  for (size_t i = 0; i < ninputs; i++) {
+    RAI_Tensor *input = RAI_ModelRunCtxInputTensor(rinfo->mctx, i);
+    const DLDataType dtype = RAI_TensorDataType(input);
+    const int ndims = RAI_TensorNumDims(input);
+    sig = array_append(sig, ((int64_t)dtype.code << 32) |
+                                ((int64_t)dtype.bits << 16) | dtype.lanes);
+    sig = array_append(sig, (int64_t)ndims);
+    for (int j = 1; j < ndims; j++) {
+      /* inputs that fall in the same PADBUCKETS length get padded to it */
+      const long long dim = RAI_TensorDim(input, j);
+      sig = array_append(sig, j == 1 ? RAI_ModelPadLength(rinfo->mctx->model, dim) : dim);
+    }
+  }
+  run_queue_info->signature_buf = sig;
+  return sig;
+}
 
-        queueItem *next_item = item->next;
+/* Links a tenant that has requests waiting again at the end of the ring,
+ * i.e. right before the current tenant. */
+static void runQueueLinkTenant(RunQueueInfo *run_queue_info,
+                               RunTenant *tenant) {
+  RunTenant *current = run_queue_info->drr_current;
+  if (current == NULL) {
+    tenant->prev = tenant;
+    tenant->next = tenant;
+    run_queue_info->drr_current = tenant;
+    return;
+  }
+  tenant->next = current;
+  tenant->prev = current->prev;
+  current->prev->next = tenant;
+  current->prev = tenant;
+}
 
-        while (next_item != NULL) {
-          RedisAI_RunInfo *next_rinfo = (RedisAI_RunInfo *)next_item->value;
+/* Takes a tenant without requests waiting out of the ring, and forfeits the
+ * credit it had left. */
+static void runQueueUnlinkTenant(RunQueueInfo *run_queue_info,
+                                 RunTenant *tenant) {
+  if (tenant->next == tenant) {
+    run_queue_info->drr_current = NULL;
+  } else {
+    tenant->prev->next = tenant->next;
+    tenant->next->prev = tenant->prev;
+    if (run_queue_info->drr_current == tenant) {
+      run_queue_info->drr_current = tenant->next;
+    }
+  }
+  tenant->prev = NULL;
+  tenant->next = NULL;
+  /* the workers may be charging it concurrently, keep any debt */
+  long long deficit_us = atomic_load(&tenant->deficit_us);
+  while (deficit_us > 0 &&
+         !atomic_compare_exchange_weak(&tenant->deficit_us, &deficit_us, 0)) {
+  }
+}
 
-          if (RAI_RunInfoBatchable(rinfo, next_rinfo) == 0) {
-            next_item = queueNext(next_item);
-            continue;
-          }
+/**
+ * Moves everything the clients pushed onto the run queue to the sub-queues.
+ * Batcher thread only.
+ */
+static void runQueueDrain(RunQueueInfo *run_queue_info) {
+  RedisAI_RunInfo *rinfo;
+  while ((rinfo = queuePop(run_queue_info->run_queue)) != NULL) {
+    rinfo->queue_seq = run_queue_info->next_seq++;
 
-          int next_batchsize = RAI_RunInfoBatchSize(next_rinfo);
+    RunTenant *tenant = rinfo->tenant;
+    if (tenant->npending++ == 0) {
+      runQueueLinkTenant(run_queue_info, tenant);
+    }
+    if (tenant->unbatched == NULL) {
+      tenant->unbatched = runSubQueueCreate(NULL, 0);
+      tenant->unbatched->tenant = tenant;
+    }
 
-          if (current_batchsize + next_batchsize > batchsize) {
-            break;
-          }
+    RunSubQueue *sq = tenant->unbatched;
+    int64_t *sig = runQueueSignature(run_queue_info, rinfo);
+    if (sig && rinfo->mctx->model->opts.targetlatency > 0) {
+      RAI_ModelAddArrival(rinfo->mctx->model, RAI_RunInfoBatchSize(rinfo),
+                          rinfo->enqueue_us);
+    }
+    if (sig) {
+      RunSubQueue probe = {
+          .signature = sig,
+          .hash = AI_dictGenHashFunction(sig, array_len(sig) * sizeof(int64_t))};
+      AI_dictEntry *entry = AI_dictFind(run_queue_info->batch_queues, &probe);
+      if (entry) {
+        sq = AI_dictGetVal(entry);
+      } else {
+        sq = runSubQueueCreate(sig, probe.hash);
+        sq->tenant = tenant;
+        AI_dictAdd(run_queue_info->batch_queues, sq, sq);
+      }
+    }
+    if (runSubQueueLength(sq) == 0) {
+      runQueueLinkSubQueue(run_queue_info, sq);
+    }
+    runSubQueuePush(sq, rinfo);
+  }
+}
 
-          array_append(evicted_items, next_item);
-          array_append(batch_rinfo, next_rinfo);
+static inline int runInfoExpired(const RedisAI_RunInfo *rinfo, long long now_us) {
+  return rinfo->deadline_us > 0 && rinfo->deadline_us <= now_us;
+}
 
-          current_batchsize += next_batchsize;
-          next_item = queueNext(next_item);
-        }
+/* Requests that must be dropped rather than run: their client went away, or
+ * they are past their deadline. */
+static inline int runInfoDropped(RedisAI_RunInfo *rinfo, long long now_us) {
+  return RAI_RunInfoCancelled(rinfo) || runInfoExpired(rinfo, now_us);
+}
 
-        size_t minbatchsize = rinfo->mctx->model->opts.minbatchsize;
+static inline void lowerDeadline(long long *deadline_us, long long time_us) {
+  if (*deadline_us == 0 || time_us < *deadline_us) {
+    *deadline_us = time_us;
+  }
+}
 
-        if (minbatchsize == 0 || current_batchsize >= minbatchsize) {
-          break;
-        }
+/**
+ * Can the front of the sub-queue run right now?
+ *
+ * Without BATCHTIMEOUT, a batch is ready once it reaches minbatchsize. With
+ * BATCHTIMEOUT, it is ready once it reaches minbatchsize, or batchsize if no
+ * minbatchsize is set, or once its front request has waited BATCHTIMEOUT.
+ * With TARGETLATENCY, it is ready once it reaches the batch size picked from
+ * the model's latency curve, or once running it right away is needed for its
+ * front request to complete within TARGETLATENCY.
+ * A sub-queue whose front request is past its deadline or cancelled is always
+ * ready, so that the request is dropped without waiting for the batch.
+ *
+ * @param sq
+ * @param now_us current time
+ * @param deadline_us if the sub-queue is not ready, lowered to the time at
+ * which it will be
+ * @return 1 if ready, 0 otherwise
+ */
+static int runSubQueueReady(RunSubQueue *sq, long long now_us,
+                            long long *deadline_us) {
+  if (runSubQueueLength(sq) == 0) {
+    return 0;
+  }
+  RedisAI_RunInfo *front = runSubQueueFront(sq);
+  if (sq->signature == NULL || runInfoDropped(front, now_us)) {
+    return 1;
+  }
 
-        item = item->next;
-      }
+  RAI_Model *model = front->mctx->model;
+  const RAI_ModelOpts *opts = &model->opts;
+  if (opts->targetlatency > 0) {
+    const long long flush_us =
+        front->enqueue_us + (long long)opts->targetlatency * 1000 -
+        RAI_ModelEstimatedRunTime(model, sq->nsamples);
+    if (sq->nsamples >= RAI_ModelTargetBatchSize(model) || flush_us <= now_us) {
+      return 1;
+    }
+    lowerDeadline(deadline_us, flush_us);
+  } else if (opts->batchtimeout == 0) {
+    if (opts->minbatchsize == 0 || sq->nsamples >= opts->minbatchsize) {
+      return 1;
+    }
+  } else {
+    const size_t target =
+        opts->minbatchsize > 0 ? opts->minbatchsize : opts->batchsize;
+    const long long flush_us =
+        front->enqueue_us + (long long)opts->batchtimeout * 1000;
+    if (sq->nsamples >= target || flush_us <= now_us) {
+      return 1;
+    }
+    lowerDeadline(deadline_us, flush_us);
+  }
 
-      if (item == NULL) {
-        array_free(evicted_items);
-        array_free(batch_rinfo);
-        pthread_mutex_unlock(&run_queue_info->run_queue_mutex);
-        break;
+  if (front->deadline_us > 0) {
+    lowerDeadline(deadline_us, front->deadline_us);
+  }
+  return 0;
+}
+
+/* Removes an empty sub-queue of batchable requests and frees it. */
+static void runQueueRemoveSubQueue(RunQueueInfo *run_queue_info,
+                                   RunSubQueue *sq) {
+  AI_dictDelete(run_queue_info->batch_queues, sq);
+  runQueueUnlinkSubQueue(run_queue_info, sq);
+  runSubQueueFree(sq);
+}
+
+/**
+ * Deficit round-robin: picks the tenant that runs next among the ones marked
+ * with `epoch`, i.e. with a sub-queue ready at the highest PRIORITY. The
+ * current tenant keeps running while it has credit left; otherwise the next
+ * tenant of the ring with credit does. If none has, every candidate is granted
+ * its quantum, times its weight, for as many rounds as it takes for one of
+ * them to have credit, and the round starts over after the current tenant.
+ * Batcher thread only.
+ *
+ * @return the tenant, or NULL if no tenant is marked
+ */
+static RunTenant *runQueuePickTenant(RunQueueInfo *run_queue_info,
+                                     unsigned long long epoch) {
+  RunTenant *current = run_queue_info->drr_current;
+  if (current == NULL) {
+    return NULL;
+  }
+
+  long long rounds = 0;
+  RunTenant *tenant = current;
+  do {
+    if (tenant->epoch == epoch) {
+      const long long deficit_us = atomic_load(&tenant->deficit_us);
+      if (deficit_us > 0) {
+        run_queue_info->drr_current = tenant;
+        return tenant;
       }
+      const long long quantum_us =
+          RUN_QUEUE_DRR_QUANTUM_US * atomic_load(&tenant->weight);
+      const long long needed = -deficit_us / quantum_us + 1;
+      if (rounds == 0 || needed < rounds) {
+        rounds = needed;
+      }
+    }
+    tenant = tenant->next;
+  } while (tenant != current);
+
+  if (rounds == 0) {
+    return NULL;
+  }
 
-      for (long long i = 0; i < array_len(evicted_items); i++) {
-        queueEvict(run_queue_info->run_queue, evicted_items[i]);
+  RunTenant *picked = NULL;
+  tenant = current->next;
+  do {
+    if (tenant->epoch == epoch) {
+      const long long quantum_us =
+          RUN_QUEUE_DRR_QUANTUM_US * atomic_load(&tenant->weight);
+      const long long deficit_us =
+          atomic_fetch_add(&tenant->deficit_us, rounds * quantum_us) +
+          rounds * quantum_us;
+      /* workers charging concurrently may leave none with credit */
+      if (picked == NULL || (deficit_us > 0 &&
+                             atomic_load(&picked->deficit_us) <= 0)) {
+        picked = tenant;
       }
+    }
+    tenant = tenant->next;
+  } while (tenant != current->next);
+
+  run_queue_info->drr_current = picked;
+  return picked;
+}
+
+/**
+ * Picks the next batch to run out of the sub-queues and removes it from them.
+ * Among the sub-queues that can run, sub-queues of batchable requests being
+ * ready according to runSubQueueReady, only the ones whose front request has
+ * the highest PRIORITY are considered. The tenant is picked among theirs with
+ * deficit round-robin (see runQueuePickTenant), and then the sub-queue of the
+ * tenant whose front request comes first in scheduling order (see
+ * runInfoCompare); sub-queues of batchable requests give up to batchsize
+ * samples from their front. Requests found past their deadline or cancelled
+ * on the way are removed as well and handed back in `dropped`.
+ * Only the chosen sub-queue's items are looked at, so the cost is linear in
+ * the number of sub-queues and of tenants waiting, plus the size of the batch
+ * (times the log of the sub-queue length).
+ * Batcher thread only.
+ *
+ * @param run_queue_info
+ * @param dropped array to which requests that must not run are appended
+ * @param deadline_us set to the time at which a waiting batch will be ready,
+ * 0 if none
+ * @return an array with the items to run together, empty if nothing can run
+ */
+static RedisAI_RunInfo **runQueueNextBatch(RunQueueInfo *run_queue_info,
+                                           RedisAI_RunInfo ***dropped,
+                                           long long *deadline_us) {
+  RedisAI_RunInfo **batch_rinfo = array_new(RedisAI_RunInfo *, 1);
+  const long long now_us = ustime();
+  const unsigned long long epoch = ++run_queue_info->drr_epoch;
+  *deadline_us = 0;
+
+  int ready = 0;
+  long long priority = 0;
+  for (RunSubQueue *sq = run_queue_info->subqueues; sq; sq = sq->next) {
+    if (!runSubQueueReady(sq, now_us, deadline_us)) {
+      continue;
+    }
+    sq->ready_epoch = epoch;
+    if (!ready || runSubQueueFront(sq)->priority > priority) {
+      priority = runSubQueueFront(sq)->priority;
+      ready = 1;
+    }
+  }
+
+  if (!ready) {
+    return batch_rinfo;
+  }
+
+  for (RunSubQueue *sq = run_queue_info->subqueues; sq; sq = sq->next) {
+    if (sq->ready_epoch != epoch || runSubQueueFront(sq)->priority != priority) {
+      continue;
+    }
+    RunTenant *tenant = sq->tenant;
+    if (tenant->epoch != epoch ||
+        runInfoCompare(runSubQueueFront(sq),
+                       runSubQueueFront(tenant->candidate)) > 0) {
+      tenant->epoch = epoch;
+      tenant->candidate = sq;
+    }
+  }
+
+  RunTenant *tenant = runQueuePickTenant(run_queue_info, epoch);
+  if (tenant == NULL) {
+    /* a ready sub-queue always has its tenant in the ring */
+    return batch_rinfo;
+  }
+  RunSubQueue *best = tenant->candidate;
+
+  size_t batchsize = 1;
+  if (best->signature) {
+    RAI_Model *model = runSubQueueFront(best)->mctx->model;
+    batchsize = model->opts.targetlatency > 0 ? RAI_ModelTargetBatchSize(model)
+                                              : model->opts.batchsize;
+  }
+  size_t current_batchsize = 0;
+  while (runSubQueueLength(best) > 0) {
+    RedisAI_RunInfo *front = runSubQueueFront(best);
+    if (runInfoDropped(front, now_us)) {
+      *dropped = array_append(*dropped, runSubQueuePop(best));
+      tenant->npending--;
+      continue;
+    }
+    const size_t next_batchsize =
+        best->signature ? RAI_RunInfoBatchSize(front) : 1;
+    if (current_batchsize > 0 &&
+        current_batchsize + next_batchsize > batchsize) {
+      break;
+    }
+    batch_rinfo = array_append(batch_rinfo, runSubQueuePop(best));
+    tenant->npending--;
+    current_batchsize += next_batchsize;
+  }
+
+  if (runSubQueueLength(best) == 0) {
+    if (best->signature) {
+      runQueueRemoveSubQueue(run_queue_info, best);
+    } else {
+      runQueueUnlinkSubQueue(run_queue_info, best);
+    }
+  }
+  if (tenant->npending == 0) {
+    runQueueUnlinkTenant(run_queue_info, tenant);
+  }
+
+  return batch_rinfo;
+}
 
-      pthread_mutex_unlock(&run_queue_info->run_queue_mutex);
+/* Unblocks the clients of dropped requests, replying with a timeout error to
+ * the ones that are past their deadline. Cancelled requests get no reply,
+ * their context is freed once unblocked. */
+static void runQueueDrop(RedisAI_RunInfo **dropped) {
+  for (uint32_t i = 0; i < array_len(dropped); i++) {
+    RedisAI_RunInfo *rinfo = dropped[i];
+    rinfo->result = REDISMODULE_ERR;
+    if (!RAI_RunInfoCancelled(rinfo)) {
+      RAI_SetError(rinfo->err, RAI_ETIMEDOUT,
+                   "ERR Timed out while waiting in the run queue");
+    }
+    if (rinfo->parent != NULL) {
+      RAI_ModelRunChunkDone(rinfo);
+    } else if (rinfo->client != NULL) {
+      RedisModule_UnblockClient(rinfo->client, rinfo);
+    }
+  }
+}
+
+/**
+ * Takes one of the pending retirement requests, if any, on behalf of the
+ * calling worker, which must then exit. A sibling is woken up in its place,
+ * in case the wakeup this worker consumed was meant for a ready batch.
+ *
+ * @return 1 if the worker must exit, 0 otherwise
+ */
+static int runQueueRetireWorker(RunQueueInfo *run_queue_info) {
+  int retire = 0;
+  pthread_mutex_lock(&run_queue_info->park_mutex);
+  if (atomic_load(&run_queue_info->nretire) > 0) {
+    atomic_fetch_sub(&run_queue_info->nretire, 1);
+    run_queue_info->retired =
+        array_append(run_queue_info->retired, pthread_self());
+    retire = 1;
+  }
+  pthread_mutex_unlock(&run_queue_info->park_mutex);
+  if (retire) {
+    atomic_fetch_sub(&run_queue_info->nidle, 1);
+    runQueueWakeWorker(run_queue_info);
+  }
+  return retire;
+}
 
-      if (array_len(batch_rinfo) > 0) {
-        if (batch_rinfo[0]->use_local_context == 1) {
-          RedisAI_DagRunSession(batch_rinfo[0]);
-        } else {
-          RAI_ModelRunScriptRunSession(batch_rinfo);
+/* Wakes up a parked worker of another CPU device, if any, to take a batch
+ * that the workers of the run queue cannot start right away. */
+static void runQueueWakeThief(RunQueueInfo *run_queue_info) {
+  if (atomic_load(&run_queue_info->steal_threshold) == 0) {
+    return;
+  }
+  const int nqueues = atomic_load(&ncpu_run_queues);
+  for (int i = 0; i < nqueues; i++) {
+    RunQueueInfo *thief = cpu_run_queues[i];
+    if (thief != run_queue_info && atomic_load(&thief->parked) > 0) {
+      runQueueWakeWorker(thief);
+      return;
+    }
+  }
+}
+
+/* Records the time the requests of a batch about to run spent in the run
+ * queue, for them and for their tenant. Batcher thread only. */
+static void runTenantAddWaits(RunTenant *tenant,
+                              RedisAI_RunInfo **batch_rinfo) {
+  const long long now_us = ustime();
+  long long wait_us = 0;
+  long long max_wait_us = atomic_load(&tenant->max_wait_us);
+  for (uint32_t i = 0; i < array_len(batch_rinfo); i++) {
+    RedisAI_RunInfo *rinfo = batch_rinfo[i];
+    rinfo->queue_wait_us = now_us - rinfo->enqueue_us;
+    wait_us += rinfo->queue_wait_us;
+    if (rinfo->queue_wait_us > max_wait_us) {
+      max_wait_us = rinfo->queue_wait_us;
+    }
+  }
+  atomic_fetch_add(&tenant->nruns, array_len(batch_rinfo));
+  atomic_fetch_add(&tenant->wait_us, wait_us);
+  atomic_store(&tenant->max_wait_us, max_wait_us);
+}
+
+static RunBatch *runBatchCreate(RedisAI_RunInfo **batch_rinfo, int dropped) {
+  RunBatch *batch = RedisModule_Calloc(1, sizeof(RunBatch));
+  batch->rinfo = batch_rinfo;
+  batch->dropped = dropped;
+  return batch;
+}
+
+/* Hands a batch over to the completion thread. */
+static void runQueuePushDone(RunQueueInfo *run_queue_info, RunBatch *batch) {
+  while (!queuePush(run_queue_info->done_queue, batch)) {
+    runQueueStageWake(&run_queue_info->completer);
+    sched_yield();
+  }
+  runQueueStageWake(&run_queue_info->completer);
+}
+
+void *RedisAI_Batcher_ThreadMain(void *arg) {
+  RunQueueInfo *run_queue_info = (RunQueueInfo *)arg;
+  pthread_t self = pthread_self();
+#ifdef __APPLE__
+  int res = pthread_setname_np("redisai_batcher");
+#else
+  int res = pthread_setname_np(self, "redisai_batcher");
+#endif
+  while (!atomic_load(&run_queue_info->batcher.stopping)) {
+    atomic_store(&run_queue_info->batcher.wakeup, 0);
+    runQueueDrain(run_queue_info);
+
+    /* Only form batches that a worker can start right away, including the
+     * idle workers of the other CPU devices if the queue lends them work: the
+     * requests arriving while all the workers are busy join the next
+     * batches */
+    long long deadline_us = 0;
+    while (runQueueSurplus(run_queue_info) < 0 ||
+           (runQueueLendsWork(run_queue_info) &&
+            runQueueSurplus(run_queue_info) <
+                runQueueIdleThieves(run_queue_info))) {
+      RedisAI_RunInfo **dropped = array_new(RedisAI_RunInfo *, 1);
+      RedisAI_RunInfo **batch_rinfo =
+          runQueueNextBatch(run_queue_info, &dropped, &deadline_us);
+
+      const int ndropped = array_len(dropped);
+      const long long batch_len = array_len(batch_rinfo);
+      atomic_fetch_sub(&run_queue_info->npending, batch_len + ndropped);
+      if (ndropped > 0) {
+        runQueuePushDone(run_queue_info, runBatchCreate(dropped, 1));
+      } else {
+        array_free(dropped);
+      }
+
+      if (batch_len == 0) {
+        array_free(batch_rinfo);
+        if (ndropped == 0) {
+          break;
         }
+        continue;
       }
 
-      for (long long i = 0; i < array_len(evicted_items); i++) {
-        RedisModule_Free(evicted_items[i]);
+      RunBatch *batch = runBatchCreate(batch_rinfo, 0);
+      batch->tenant = batch_rinfo[0]->tenant;
+      runTenantAddWaits(batch->tenant, batch_rinfo);
+      if (batch_rinfo[0]->use_local_context != 1) {
+        batch->mctx = RAI_ModelRunScriptRunPrepare(batch_rinfo);
+      }
+      queuePush(run_queue_info->ready_queue, batch);
+      runQueueWakeWorker(run_queue_info);
+      if (runQueueSurplus(run_queue_info) > 0) {
+        runQueueWakeThief(run_queue_info);
       }
-      array_free(evicted_items);
-      array_free(batch_rinfo);
+    }
 
-      pthread_mutex_lock(&run_queue_info->run_queue_mutex);
+    runQueueStageWait(&run_queue_info->batcher, deadline_us);
+  }
+  return NULL;
+}
 
-      run_queue_len = queueLength(run_queue_info->run_queue);
+void *RedisAI_Run_ThreadMain(void *arg) {
+  RunQueueInfo *run_queue_info = (RunQueueInfo *)arg;
+  pthread_t self = pthread_self();
+#ifdef __APPLE__
+  int res = pthread_setname_np("redisai_bthread");
+#else
+  int res = pthread_setname_np(self, "redisai_bthread");
+#endif
+  atomic_fetch_add(&run_queue_info->nidle, 1);
+  runQueueStageWake(&run_queue_info->batcher);
+  while (true) {
+    if (atomic_load_explicit(&run_queue_info->nretire, memory_order_relaxed) >
+            0 &&
+        runQueueRetireWorker(run_queue_info)) {
+      return NULL;
+    }
+
+    RunQueueInfo *owner = run_queue_info;
+    RunBatch *batch = queuePop(run_queue_info->ready_queue);
+    if (batch == NULL) {
+      batch = runQueueSteal(run_queue_info, &owner);
+    }
+    if (batch == NULL) {
+      runQueueWait(run_queue_info);
+      continue;
+    }
+    atomic_fetch_sub(&run_queue_info->nidle, 1);
+
+    const long long batch_len = array_len(batch->rinfo);
+    const long long start_us = ustime();
+    if (batch->rinfo[0]->use_local_context == 1) {
+      RedisAI_DagRunSession(batch->rinfo[0]);
+    } else {
+      RAI_ModelRunScriptRunSession(batch->rinfo, batch->mctx);
+    }
+    const long long run_us = ustime() - start_us;
+    runQueueUpdateItemTime(owner, run_us / batch_len);
+    atomic_fetch_sub(&batch->tenant->deficit_us, run_us);
+    atomic_fetch_add(&batch->tenant->run_us, run_us);
+
+    runQueuePushDone(owner, batch);
+    atomic_fetch_add(&run_queue_info->nidle, 1);
+    runQueueStageWake(&run_queue_info->batcher);
+    if (owner != run_queue_info) {
+      runQueueStageWake(&owner->batcher);
+    }
+  }
+}
+
+/* Slices the outputs of a batch back into its requests and unblocks their
+ * clients, or drops the requests of a batch of dropped ones. */
+static void runBatchComplete(RunBatch *batch) {
+  if (batch->dropped) {
+    runQueueDrop(batch->rinfo);
+  } else if (batch->rinfo[0]->use_local_context == 1) {
+    if (batch->rinfo[0]->client != NULL) {
+      RedisModule_UnblockClient(batch->rinfo[0]->client, batch->rinfo[0]);
+    }
+  } else {
+    RAI_ModelRunScriptRunComplete(batch->rinfo, batch->mctx);
+  }
+  array_free(batch->rinfo);
+  RedisModule_Free(batch);
+}
+
+void *RedisAI_Complete_ThreadMain(void *arg) {
+  RunQueueInfo *run_queue_info = (RunQueueInfo *)arg;
+  pthread_t self = pthread_self();
+#ifdef __APPLE__
+  int res = pthread_setname_np("redisai_cthread");
+#else
+  int res = pthread_setname_np(self, "redisai_cthread");
+#endif
+  while (true) {
+    atomic_store(&run_queue_info->completer.wakeup, 0);
+    RunBatch *batch;
+    while ((batch = queuePop(run_queue_info->done_queue)) != NULL) {
+      runBatchComplete(batch);
+    }
+    if (atomic_load(&run_queue_info->completer.stopping)) {
+      return NULL;
     }
+    runQueueStageWait(&run_queue_info->completer, 0);
   }
 }
@@ -2,6 +2,7 @@
 #define SRC_BACKGROUND_WORKERS_H_
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "config.h"
 #include "dag.h"
@@ -10,6 +11,8 @@
 #include "redisai.h"
 #include "rmutil/alloc.h"
 #include "rmutil/args.h"
+#include "rmutil/priority_queue.h"
+#include "run_info.h"
 #include "script.h"
 #include "stats.h"
 #include "tensor.h"
@@ -17,15 +20,176 @@
 #include "util/dict.h"
 #include "util/queue.h"
 
+/* Number of slots pre-allocated in each device run queue, and in each of the
+ * queues between its stages */
+#define RUN_QUEUE_CAPACITY 65536
+/* Number of times an idle thread polls its queue before parking */
+#define RUN_QUEUE_SPIN_ITERATIONS 1024
+/* Maximum number of CPU devices that share their workers with WORK_STEALING */
+#define RUN_QUEUE_MAX_CPU_QUEUES 64
+/* Weight of the latest run in the average run time per item, as a shift */
+#define RUN_QUEUE_ITEM_TIME_SHIFT 3
+/* Run time granted to a tenant of WEIGHT 1 per round of the deficit
+ * round-robin */
+#define RUN_QUEUE_DRR_QUANTUM_US 1000
+
 AI_dict *run_queues;
 long long perqueueThreadPoolSize;
 
+/**
+ * Pending items that can run together, ordered by PRIORITY, then by deadline
+ * (earliest first, requests without TIMEOUT last), then by arrival.
+ *
+ * Batchable MODELRUN requests are grouped by model and by the shape and type
+ * of their inputs past the batch dimension (`signature`), so that a batch can
+ * be taken from the front of a single sub-queue. Everything else (scripts,
+ * DAGs, models without a batchsize) goes to the sub-queue without signature
+ * of its tenant and runs one item at a time.
+ */
+typedef struct RunSubQueue {
+  int64_t *signature;
+  uint64_t hash;
+  PriorityQueue *items;
+  size_t nsamples;
+  struct RunTenant *tenant;
+  unsigned long long ready_epoch;  // last pass of the batcher it was ready in
+  struct RunSubQueue *prev;
+  struct RunSubQueue *next;
+} RunSubQueue;
+
+/**
+ * A tenant of a run queue: the models and scripts sharing a TAG, or a model
+ * or script without TAG on its own. DAGs all belong to the tenant named "".
+ *
+ * The batcher shares the run time of the device among the tenants with
+ * requests waiting, in proportion to their `weight`, with a deficit
+ * round-robin: `deficit_us` is the run time the tenant is still owed in the
+ * current round, and the workers charge it with the run time of its batches
+ * as they complete them. Tenants with requests waiting are linked in a ring;
+ * the batcher keeps serving the current tenant while it has credit left, and
+ * grants `weight` quanta to each of them when none has. A tenant leaves the
+ * ring, and loses the credit it has left, once it has no requests waiting;
+ * a debt is kept.
+ *
+ * Tenants are created by the main thread and live as long as their run
+ * queue. The ring, `unbatched` and `npending` belong to the batcher.
+ */
+typedef struct RunTenant {
+  char *name;
+  atomic_llong weight;
+  atomic_llong deficit_us;
+  RunSubQueue *unbatched;
+  long long npending;
+  unsigned long long epoch;  // last pass of the batcher it could run in
+  RunSubQueue *candidate;    // its best ready sub-queue in that pass
+  struct RunTenant *prev;
+  struct RunTenant *next;
+  // Statistics, see AI.INFO
+  atomic_llong nruns;
+  atomic_llong wait_us;
+  atomic_llong max_wait_us;
+  atomic_llong run_us;
+} RunTenant;
+
+/**
+ * A batch on its way through the stages of a run queue. `mctx` holds the
+ * inputs of a MODELRUN batch of several requests, concatenated by the
+ * batcher, and NULL when the requests run with their own run contexts.
+ * `dropped` batches hold requests that must not run, and go straight to the
+ * completion thread.
+ */
+typedef struct RunBatch {
+  RedisAI_RunInfo **rinfo;
+  RAI_ModelRunCtx *mctx;
+  int dropped;
+  RunTenant *tenant;
+} RunBatch;
 
+/**
+ * A single thread stage of a run queue, the batcher or the completion thread.
+ * The thread polls for a while and then parks on `condition_var` until
+ * `wakeup` is raised, with the same handshake as the workers on `parked`.
+ */
+typedef struct RunQueueStage {
+  pthread_t thread;
+  int started;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition_var;
+  atomic_int parked;
+  atomic_int wakeup;
+  atomic_int stopping;
+} RunQueueStage;
+
+/**
+ * Per-device run queue, run as a pipeline of three stages.
+ *
+ * Clients push work onto `run_queue`, a bounded lock-free queue, so that the
+ * main thread never contends with the other threads. The batcher thread
+ * drains it into the sub-queues, which only it ever touches, and assembles
+ * batches from there. `subqueues` links the non-empty sub-queues. Within the
+ * highest PRIORITY ready to run, the batcher picks the tenant with deficit
+ * round-robin over `drr_current`, see RunTenant, and then the tenant's next
+ * batch in scheduling order. `tenants` maps the tenant names to the tenants,
+ * main thread only. The batcher also prepares the batches, i.e.
+ * concatenates the inputs of MODELRUN batches, and pushes them onto
+ * `ready_queue`. It only forms a batch when a worker is idle, as counted by
+ * `nidle`, so that requests keep piling up into larger batches while all the
+ * workers are busy.
+ *
+ * The workers run the batches of `ready_queue` on the backends and push them
+ * onto `done_queue`, where the completion thread slices the outputs of the
+ * batches back into their requests and unblocks the clients.
+ *
+ * Idle workers spin on the ready queue for a while and then park on
+ * `park_condition_var`. A worker announces itself in `parked` before
+ * re-checking the ready queue, and the batcher checks `parked` after pushing,
+ * so a push is either seen by the worker or followed by a wakeup.
+ *
+ * With WORK_STEALING, the run queues of the CPU devices (`cpu` set) share
+ * their workers: once `steal_threshold` requests are waiting in a CPU run
+ * queue, the batcher also forms batches for the idle workers of the other CPU
+ * devices, which take the batches the workers of the device cannot start
+ * right away off its ready queue. A stolen batch is completed by the
+ * completion thread of the run queue it was taken from.
+ *
+ * `npending` counts the requests pushed and not yet taken by the batcher, and
+ * `item_us` is a moving average of the run time per request; together they
+ * give the admission control an estimate of the wait of a new request.
+ *
+ * `threads` holds the workers not yet joined, `nworkers` is the size the pool
+ * is meant to have. Shrinking the pool raises `nretire`: that many workers
+ * exit when they are done with their current batch and add themselves to
+ * `retired`, to be joined by the main thread. `threads` and `nworkers` are
+ * only touched by the main thread, `retired` and `nretire` under
+ * `park_mutex`. If `cpus` is set, all the threads of the run queue are pinned
+ * to those cores.
+ */
 typedef struct RunQueueInfo {
-  pthread_mutex_t run_queue_mutex;
-  pthread_cond_t queue_condition_var;
   queue *run_queue;
+  queue *ready_queue;
+  queue *done_queue;
+  RunSubQueue *subqueues;
+  AI_dict *tenants;
+  RunTenant *drr_current;
+  unsigned long long drr_epoch;
+  AI_dict *batch_queues;
+  int64_t *signature_buf;
+  unsigned long long next_seq;
+  RunQueueStage batcher;
+  RunQueueStage completer;
+  pthread_mutex_t park_mutex;
+  pthread_cond_t park_condition_var;
+  atomic_int parked;
+  atomic_int nidle;
+  int cpu;
+  atomic_llong steal_threshold;
+  atomic_llong npending;
+  atomic_llong item_us;
   pthread_t *threads;
+  pthread_t *retired;
+  atomic_int nretire;
+  long long nworkers;
+  int *cpus;
 } RunQueueInfo;
 
 int freeRunQueueInfo(RunQueueInfo *info);
@@ -34,4 +198,170 @@ int freeRunQueueInfo(RunQueueInfo *info);
  * If not, create it. */
 int ensureRunQueue(const char *devicestr, RunQueueInfo **run_queue_info);
 
+/**
+ * Grows or shrinks the pool of workers of a run queue. New workers are
+ * started right away; when shrinking, workers finish the batch they are
+ * running before exiting, and requests already queued are left for the
+ * remaining workers. Main thread only.
+ *
+ * @param run_queue_info
+ * @param nworkers number of workers, at least 1
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR if the size is invalid
+ * or a worker could not be started
+ */
+int resizeRunQueue(RunQueueInfo *run_queue_info, long long nworkers);
+
+/**
+ * Sets the number of waiting requests from which the idle workers of the
+ * other CPU devices take batches from a CPU device run queue. Main thread
+ * only.
+ *
+ * @param run_queue_info
+ * @param min_pending number of waiting requests, 0 to disable work stealing
+ * from the run queue
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR if the run queue is
+ * not the one of a CPU device
+ */
+int setRunQueueWorkStealing(RunQueueInfo *run_queue_info, long long min_pending);
+
+/**
+ * Sets the work stealing threshold of all the CPU device run queues, see
+ * setRunQueueWorkStealing. Main thread only.
+ *
+ * @param min_pending number of waiting requests, 0 to disable work stealing
+ */
+void setRunQueuesWorkStealing(long long min_pending);
+
+/**
+ * Sets the weight of a tenant in all the run queues, overriding the WEIGHT of
+ * its models and scripts. Main thread only.
+ *
+ * @param name tenant, i.e. a TAG, or the key of a model or script without TAG
+ * @param weight share of the device run time, 0 to fall back to the WEIGHT of
+ * the models and scripts
+ */
+void setRunQueuesTenantWeight(const char *name, long long weight);
+
+/**
+ * Counts the WEIGHT of a model or script entering the keyspace in the weight
+ * of its tenant. Main thread only.
+ *
+ * @param tag TAG of the model or script
+ * @param key key of the model or script
+ * @param weight WEIGHT of the model or script
+ */
+void runQueuesAddTenantKey(const char *tag, const char *key, long long weight);
+
+/**
+ * Stops counting the WEIGHT of a model or script leaving the keyspace in the
+ * weight of its tenant. Main thread only.
+ *
+ * @param tag TAG of the model or script
+ * @param key key of the model or script
+ * @param weight WEIGHT of the model or script
+ */
+void runQueuesRemoveTenantKey(const char *tag, const char *key,
+                              long long weight);
+
+/**
+ * @param tag TAG of a model or script
+ * @param key key of the model or script
+ * @return name of the tenant the runs of the model or script belong to
+ */
+const char *runQueueTenantName(const char *tag, const char *key);
+
+/**
+ * @param name tenant
+ * @return the weight of the tenant set with setRunQueuesTenantWeight if any,
+ * the largest WEIGHT of its models and scripts in the keyspace otherwise, 1 if
+ * it has none. Main thread only.
+ */
+long long runQueueTenantWeight(const char *name);
+
+/**
+ * @param run_queue_info
+ * @param name tenant
+ * @return the tenant of the run queue, or NULL if none of its models or
+ * scripts ran on the device yet. Main thread only.
+ */
+RunTenant *runQueueFindTenant(RunQueueInfo *run_queue_info, const char *name);
+
+/**
+ * @return total number of workers of all the run queues, as requested with
+ * THREADS_PER_QUEUE. Main thread only.
+ */
+long long runQueuesWorkerCount(void);
+
+/**
+ * Pins the threads of a run queue, present and future, to a set of cores.
+ * Linux only. Main thread only.
+ *
+ * Logical CPU devices (CPU:<n>) are pinned to the cores of NUMA node n by
+ * default. Since the batched inputs are allocated by the batcher, and the
+ * backends allocate their intermediate and output tensors from the worker
+ * threads, pinning also keeps that memory on the node of the cores.
+ *
+ * @param run_queue_info
+ * @param cpulist cores in the format of the kernel's cpulist, e.g. "0-3,8"
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR if the list is invalid
+ * or the workers could not be pinned
+ */
+int setRunQueueAffinity(RunQueueInfo *run_queue_info, const char *cpulist);
+
+/**
+ * Admission control, to be called before blocking the client. Rejects the
+ * request if the run queue holds MAX_QUEUE_LENGTH requests already, if the
+ * estimated wait exceeds MAX_QUEUE_WAIT, or if the run queue is full. Only
+ * the main thread pushes onto the run queues, so an admitted request is
+ * guaranteed to be accepted by the following runQueuePush.
+ *
+ * @param run_queue_info
+ * @param err error to set, with code RAI_EBUSY, if the request is rejected
+ * @return REDISMODULE_OK if the request can be queued, REDISMODULE_ERR
+ * otherwise
+ */
+int runQueueAdmit(RunQueueInfo *run_queue_info, RAI_Error *err);
+
+/**
+ * Pushes a blocked command onto the run queue and wakes up the batcher if
+ * needed. The blocked client is tracked until runQueueUntrack, so that a
+ * disconnection can cancel the request.
+ *
+ * A MODELRUN identical to one already queued or running, i.e. with the same
+ * model and the same input tensors, is not queued: it waits for the outcome
+ * of the other one instead, provided that it would not be served later than
+ * on its own (see runQueueComplete).
+ *
+ * @param run_queue_info
+ * @param rinfo context of the blocked command
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR if the queue is full
+ */
+int runQueuePush(RunQueueInfo *run_queue_info, RedisAI_RunInfo *rinfo);
+
+/**
+ * Flags the request of a blocked client as cancelled, so that the batcher
+ * drops it instead of running it. Requests already running are not
+ * interrupted. Main thread only.
+ *
+ * @param bc blocked client that disconnected
+ */
+void runQueueCancelClient(RedisModuleBlockedClient *bc);
+
+/**
+ * Hands the outcome of a request pushed with runQueuePush to the identical
+ * requests that waited for it, and unblocks their clients. To be called once
+ * the request is done, before its context is freed. Main thread only.
+ *
+ * @param rinfo context of the blocked command
+ */
+void runQueueComplete(RedisAI_RunInfo *rinfo);
+
+/**
+ * Forgets the blocked client of a request pushed with runQueuePush, before its
+ * context is freed. Main thread only.
+ *
+ * @param rinfo context of the blocked command
+ */
+void runQueueUntrack(RedisAI_RunInfo *rinfo);
+
 #endif /* SRC_BACKGROUND_WORKERS_H_ */
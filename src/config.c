@@ -20,13 +20,25 @@ long long backends_intra_op_parallelism;  //  number of threads used within an
 long long
     backends_inter_op_parallelism;  //  number of threads used for parallelism
                                     //  between independent operations.
+long long core_budget;            //  number of cores shared by the workers and
+                                  //  the backends' pools, 0 for no budget.
+long long run_queue_max_length;   //  maximum number of requests waiting in a
+                                  //  run queue, 0 for no limit.
+long long run_queue_max_wait_ms;  //  maximum estimated wait in a run queue,
+                                  //  0 for no limit.
+long long run_queue_steal_threshold;  //  waiting requests from which other CPU
+                                      //  devices steal, 0 for no stealing.
 
 /**
  *
  * @return number of threads used within an individual op for parallelism.
  */
 long long getBackendsInterOpParallelism() {
-  return backends_inter_op_parallelism;
+  if (backends_inter_op_parallelism > 0 || core_budget == 0) {
+    return backends_inter_op_parallelism;
+  }
+  // the workers already run independent requests in parallel
+  return 1;
 }
 
 /**
@@ -50,7 +62,14 @@ int setBackendsInterOpParallelism(long long num_threads) {
  * @return
  */
 long long getBackendsIntraOpParallelism() {
-  return backends_intra_op_parallelism;
+  if (backends_intra_op_parallelism > 0 || core_budget == 0) {
+    return backends_intra_op_parallelism;
+  }
+  const long long nworkers = runQueuesWorkerCount();
+  if (nworkers == 0 || core_budget <= nworkers) {
+    return 1;
+  }
+  return core_budget / nworkers;
 }
 
 /**
@@ -69,6 +88,94 @@ int setBackendsIntraOpParallelism(long long num_threads) {
   return result;
 }
 
+/**
+ *
+ * @return number of cores shared by the workers and the backends' pools
+ */
+long long getCoreBudget() { return core_budget; }
+
+/**
+ * Set the number of cores shared by the RedisAI workers and the backends'
+ * thread pools.
+ *
+ * @param num_cores number of cores, 0 for no budget
+ * @return 0 on success, or 1  if failed
+ */
+int setCoreBudget(long long num_cores) {
+  int result = 1;
+  if (num_cores >= 0) {
+    core_budget = num_cores;
+    result = 0;
+  }
+  return result;
+}
+
+/**
+ *
+ * @return maximum number of requests waiting in a run queue, 0 if unbounded
+ */
+long long getRunQueueMaxLength() { return run_queue_max_length; }
+
+/**
+ * Set the maximum number of requests waiting in a device run queue.
+ *
+ * @param max_length maximum number of waiting requests, 0 for no limit
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueMaxLength(long long max_length) {
+  int result = 1;
+  if (max_length >= 0) {
+    run_queue_max_length = max_length;
+    result = 0;
+  }
+  return result;
+}
+
+/**
+ *
+ * @return maximum estimated wait in a run queue in milliseconds, 0 if
+ * unbounded
+ */
+long long getRunQueueMaxWait() { return run_queue_max_wait_ms; }
+
+/**
+ * Set the maximum estimated wait of a request in a device run queue.
+ *
+ * @param max_wait_ms maximum estimated wait in milliseconds, 0 for no limit
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueMaxWait(long long max_wait_ms) {
+  int result = 1;
+  if (max_wait_ms >= 0) {
+    run_queue_max_wait_ms = max_wait_ms;
+    result = 0;
+  }
+  return result;
+}
+
+/**
+ *
+ * @return number of waiting requests from which other CPU devices steal from
+ * a CPU run queue, 0 if work stealing is disabled
+ */
+long long getRunQueueStealThreshold() { return run_queue_steal_threshold; }
+
+/**
+ * Set the number of waiting requests from which the idle workers of the other
+ * CPU devices take batches from a CPU device run queue.
+ *
+ * @param min_pending number of waiting requests, 0 to disable work stealing
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueStealThreshold(long long min_pending) {
+  int result = 1;
+  if (min_pending >= 0) {
+    run_queue_steal_threshold = min_pending;
+    result = 0;
+  }
+  return result;
+}
+
 /**
  * Helper method for AI.CONFIG LOADBACKEND <backend_identifier>
  * <location_of_backend_library>
@@ -175,6 +282,68 @@ int RedisAI_Config_IntraOperationParallelism(
   return result;
 }
 
+/**
+ * Set the number of cores shared by the RedisAI workers and the backends'
+ * thread pools.
+ *
+ * @param num_cores_string string containing the number of cores
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_CoreBudget(RedisModuleString *num_cores_string) {
+  long long temp;
+  int result = RedisModule_StringToLongLong(num_cores_string, &temp);
+  if (result == REDISMODULE_OK && setCoreBudget(temp) != 0) {
+    result = REDISMODULE_ERR;
+  }
+  return result;
+}
+
+/**
+ * Set the maximum number of requests waiting in a device run queue.
+ *
+ * @param max_length_string string containing the maximum length
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_QueueMaxLength(RedisModuleString *max_length_string) {
+  long long temp;
+  int result = RedisModule_StringToLongLong(max_length_string, &temp);
+  if (result == REDISMODULE_OK && setRunQueueMaxLength(temp) != 0) {
+    result = REDISMODULE_ERR;
+  }
+  return result;
+}
+
+/**
+ * Set the maximum estimated wait of a request in a device run queue.
+ *
+ * @param max_wait_string string containing the maximum wait in milliseconds
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_QueueMaxWait(RedisModuleString *max_wait_string) {
+  long long temp;
+  int result = RedisModule_StringToLongLong(max_wait_string, &temp);
+  if (result == REDISMODULE_OK && setRunQueueMaxWait(temp) != 0) {
+    result = REDISMODULE_ERR;
+  }
+  return result;
+}
+
+/**
+ * Set the number of waiting requests from which the idle workers of the other
+ * CPU devices take batches from a CPU device run queue.
+ *
+ * @param min_pending_string string containing the number of waiting requests
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_WorkStealing(RedisModuleString *min_pending_string) {
+  long long temp;
+  int result = RedisModule_StringToLongLong(min_pending_string, &temp);
+  if (result == REDISMODULE_OK && setRunQueueStealThreshold(temp) != 0) {
+    result = REDISMODULE_ERR;
+  }
+  return result;
+}
+
 /**
  *
  * @param ctx Context in which Redis modules operate
@@ -228,6 +397,50 @@ int RAI_configParamParse(RedisModuleCtx *ctx, const char *key,
       RedisModule_Log(ctx, "notice", buffer);
       RedisModule_Free(buffer);
     }
+  } else if (strcasecmp((key), "CORE_BUDGET") == 0) {
+    ret = RedisAI_Config_CoreBudget(rsval);
+    if (ret == REDISMODULE_OK) {
+      char *buffer = RedisModule_Alloc(
+          (3 + strlen(REDISAI_INFOMSG_CORE_BUDGET) + strlen((val))) *
+          sizeof(*buffer));
+      sprintf(buffer, "%s: %lld", REDISAI_INFOMSG_CORE_BUDGET,
+              getCoreBudget());
+      RedisModule_Log(ctx, "notice", buffer);
+      RedisModule_Free(buffer);
+    }
+  } else if (strcasecmp((key), "MAX_QUEUE_LENGTH") == 0) {
+    ret = RedisAI_Config_QueueMaxLength(rsval);
+    if (ret == REDISMODULE_OK) {
+      char *buffer = RedisModule_Alloc(
+          (3 + strlen(REDISAI_INFOMSG_MAX_QUEUE_LENGTH) + strlen((val))) *
+          sizeof(*buffer));
+      sprintf(buffer, "%s: %lld", REDISAI_INFOMSG_MAX_QUEUE_LENGTH,
+              getRunQueueMaxLength());
+      RedisModule_Log(ctx, "notice", buffer);
+      RedisModule_Free(buffer);
+    }
+  } else if (strcasecmp((key), "MAX_QUEUE_WAIT") == 0) {
+    ret = RedisAI_Config_QueueMaxWait(rsval);
+    if (ret == REDISMODULE_OK) {
+      char *buffer = RedisModule_Alloc(
+          (3 + strlen(REDISAI_INFOMSG_MAX_QUEUE_WAIT) + strlen((val))) *
+          sizeof(*buffer));
+      sprintf(buffer, "%s: %lld", REDISAI_INFOMSG_MAX_QUEUE_WAIT,
+              getRunQueueMaxWait());
+      RedisModule_Log(ctx, "notice", buffer);
+      RedisModule_Free(buffer);
+    }
+  } else if (strcasecmp((key), "WORK_STEALING") == 0) {
+    ret = RedisAI_Config_WorkStealing(rsval);
+    if (ret == REDISMODULE_OK) {
+      char *buffer = RedisModule_Alloc(
+          (3 + strlen(REDISAI_INFOMSG_WORK_STEALING) + strlen((val))) *
+          sizeof(*buffer));
+      sprintf(buffer, "%s: %lld", REDISAI_INFOMSG_WORK_STEALING,
+              getRunQueueStealThreshold());
+      RedisModule_Log(ctx, "notice", buffer);
+      RedisModule_Free(buffer);
+    }
   } else if (strcasecmp((key), "BACKENDSPATH") == 0) {
     // already taken care of
   } else {
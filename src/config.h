@@ -18,6 +18,10 @@ typedef enum {
 typedef enum { RAI_DEVICE_CPU = 0, RAI_DEVICE_GPU = 1 } RAI_Device;
 
 #define RAI_ENC_VER 900
+// Encoding version of the model data type, bump when adding fields
+#define RAI_MODEL_ENC_VER 8
+// Encoding version of the script data type, bump when adding fields
+#define RAI_SCRIPT_ENC_VER 1
 
 //#define RAI_COPY_RUN_INPUT
 #define RAI_COPY_RUN_OUTPUT
@@ -25,6 +29,13 @@ typedef enum { RAI_DEVICE_CPU = 0, RAI_DEVICE_GPU = 1 } RAI_Device;
 #define REDISAI_DEFAULT_THREADS_PER_QUEUE 1
 #define REDISAI_DEFAULT_INTRA_OP_PARALLELISM 0
 #define REDISAI_DEFAULT_INTER_OP_PARALLELISM 0
+#define REDISAI_DEFAULT_MAX_QUEUE_LENGTH 0
+#define REDISAI_DEFAULT_CORE_BUDGET 0
+#define REDISAI_DEFAULT_MAX_QUEUE_WAIT 0
+#define REDISAI_DEFAULT_WORK_STEALING 0
+/* Largest WEIGHT of a model, script or tenant, so that the run time granted
+ * per round of the deficit round-robin cannot overflow */
+#define REDISAI_MAX_WEIGHT 1000000
 #define REDISAI_ERRORMSG_PROCESSING_ARG "ERR error processing argument"
 #define REDISAI_ERRORMSG_THREADS_PER_QUEUE \
   "ERR error setting THREADS_PER_QUEUE to"
@@ -32,6 +43,10 @@ typedef enum { RAI_DEVICE_CPU = 0, RAI_DEVICE_GPU = 1 } RAI_Device;
   "ERR error setting INTRA_OP_PARALLELISM to"
 #define REDISAI_ERRORMSG_INTER_OP_PARALLELISM \
   "ERR error setting INTER_OP_PARALLELISM to"
+#define REDISAI_ERRORMSG_CORE_BUDGET "ERR error setting CORE_BUDGET"
+#define REDISAI_ERRORMSG_MAX_QUEUE_LENGTH "ERR error setting MAX_QUEUE_LENGTH"
+#define REDISAI_ERRORMSG_MAX_QUEUE_WAIT "ERR error setting MAX_QUEUE_WAIT"
+#define REDISAI_ERRORMSG_WORK_STEALING "ERR error setting WORK_STEALING"
 
 #define REDISAI_INFOMSG_THREADS_PER_QUEUE \
   "Setting THREADS_PER_QUEUE parameter to"
@@ -39,12 +54,16 @@ typedef enum { RAI_DEVICE_CPU = 0, RAI_DEVICE_GPU = 1 } RAI_Device;
   "Setting INTRA_OP_PARALLELISM parameter to"
 #define REDISAI_INFOMSG_INTER_OP_PARALLELISM \
   "Setting INTER_OP_PARALLELISM parameter to"
+#define REDISAI_INFOMSG_CORE_BUDGET "Setting CORE_BUDGET parameter to"
+#define REDISAI_INFOMSG_MAX_QUEUE_LENGTH "Setting MAX_QUEUE_LENGTH parameter to"
+#define REDISAI_INFOMSG_MAX_QUEUE_WAIT "Setting MAX_QUEUE_WAIT parameter to"
+#define REDISAI_INFOMSG_WORK_STEALING "Setting WORK_STEALING parameter to"
 
 /**
  * Get number of threads used for parallelism between independent operations, by
- * backend.
+ * backend. Unless set explicitly, it is derived from the CORE_BUDGET, if any.
  * @return number of threads used for parallelism between independent
- * operations, by backend
+ * operations, by backend, 0 for the backend default
  */
 long long getBackendsInterOpParallelism();
 
@@ -59,9 +78,9 @@ int setBackendsInterOpParallelism(long long num_threads);
 
 /**
  * Get number of threads used within an individual op for parallelism, by
- * backend.
+ * backend. Unless set explicitly, it is derived from the CORE_BUDGET, if any.
  * @return number of threads used within an individual op for parallelism, by
- * backend.
+ * backend, 0 for the backend default
  */
 long long getBackendsIntraOpParallelism();
 
@@ -74,6 +93,72 @@ long long getBackendsIntraOpParallelism();
  */
 int setBackendsIntraOpParallelism(long long num_threads);
 
+/**
+ * Get the number of cores shared by the RedisAI workers and the backends'
+ * thread pools.
+ * @return number of cores, 0 if unbounded
+ */
+long long getCoreBudget();
+
+/**
+ * Set the number of cores shared by the RedisAI workers and the backends'
+ * thread pools. Unless INTRA_OP_PARALLELISM and INTER_OP_PARALLELISM are set,
+ * each worker gets an equal share of the budget as backend intra-op threads,
+ * and inter-op parallelism is left to the workers.
+ *
+ * @param num_cores number of cores, 0 for no budget
+ * @return 0 on success, or 1  if failed
+ */
+int setCoreBudget(long long num_cores);
+
+/**
+ * Get the maximum number of requests waiting in a device run queue.
+ * @return maximum number of waiting requests, 0 if unbounded
+ */
+long long getRunQueueMaxLength();
+
+/**
+ * Set the maximum number of requests waiting in a device run queue. Requests
+ * beyond it are rejected with a BUSY error.
+ *
+ * @param max_length maximum number of waiting requests, 0 for no limit
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueMaxLength(long long max_length);
+
+/**
+ * Get the maximum estimated wait of a request in a device run queue.
+ * @return maximum estimated wait in milliseconds, 0 if unbounded
+ */
+long long getRunQueueMaxWait();
+
+/**
+ * Set the maximum estimated wait of a request in a device run queue. Requests
+ * that would wait longer are rejected with a BUSY error.
+ *
+ * @param max_wait_ms maximum estimated wait in milliseconds, 0 for no limit
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueMaxWait(long long max_wait_ms);
+
+/**
+ * Get the number of waiting requests from which the idle workers of the other
+ * CPU devices take batches from a CPU device run queue, for the devices used
+ * from now on.
+ * @return number of waiting requests, 0 if work stealing is disabled
+ */
+long long getRunQueueStealThreshold();
+
+/**
+ * Set the number of waiting requests from which the idle workers of the other
+ * CPU devices take batches from a CPU device run queue, for the devices used
+ * from now on.
+ *
+ * @param min_pending number of waiting requests, 0 to disable work stealing
+ * @return 0 on success, or 1  if failed
+ */
+int setRunQueueStealThreshold(long long min_pending);
+
 /**
  * Helper method for AI.CONFIG LOADBACKEND <backend_identifier>
  * <location_of_backend_library>
@@ -125,6 +210,40 @@ int RedisAI_Config_InterOperationParallelism(
 int RedisAI_Config_IntraOperationParallelism(
     RedisModuleString *num_threads_string);
 
+/**
+ * Set the number of cores shared by the RedisAI workers and the backends'
+ * thread pools.
+ *
+ * @param num_cores_string string containing the number of cores
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_CoreBudget(RedisModuleString *num_cores_string);
+
+/**
+ * Set the maximum number of requests waiting in a device run queue.
+ *
+ * @param max_length_string string containing the maximum length
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_QueueMaxLength(RedisModuleString *max_length_string);
+
+/**
+ * Set the maximum estimated wait of a request in a device run queue.
+ *
+ * @param max_wait_string string containing the maximum wait in milliseconds
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_QueueMaxWait(RedisModuleString *max_wait_string);
+
+/**
+ * Set the number of waiting requests from which the idle workers of the other
+ * CPU devices take batches from a CPU device run queue.
+ *
+ * @param min_pending_string string containing the number of waiting requests
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if failed
+ */
+int RedisAI_Config_WorkStealing(RedisModuleString *min_pending_string);
+
 /**
  *
  * @param ctx Context in which Redis modules operate
@@ -57,7 +57,7 @@ void *RedisAI_DagRunSession(RedisAI_RunInfo *rinfo) {
       }
       case REDISAI_DAG_CMD_MODELRUN: {
         const int parse_result = RedisAI_Parse_ModelRun_RedisCommand(
-            NULL, currentOp->argv, currentOp->argc, &(currentOp->mctx),
+            NULL, currentOp->argv, currentOp->argc, 2, &(currentOp->mctx),
             &(currentOp->outkeys), &(currentOp->mctx->model), 1,
             &(rinfo->dagTensorsContext), 0, NULL, currentOp->err);
 
@@ -100,9 +100,6 @@ void *RedisAI_DagRunSession(RedisAI_RunInfo *rinfo) {
       }
     }
   }
-  if (rinfo->client != NULL) {
-    RedisModule_UnblockClient(rinfo->client, rinfo);
-  }
   return NULL;
 }
 
@@ -111,6 +108,14 @@ int RedisAI_DagRun_Reply(RedisModuleCtx *ctx, RedisModuleString **argv,
   REDISMODULE_NOT_USED(argv);
   REDISMODULE_NOT_USED(argc);
   RedisAI_RunInfo *rinfo = RedisModule_GetBlockedClientPrivateData(ctx);
+  if (atomic_load(&rinfo->cancelled)) {
+    // the client is gone, don't persist its outputs
+    return REDISMODULE_OK;
+  }
+  if (rinfo->result == REDISMODULE_ERR) {
+    // the DAG did not run at all, e.g. it timed out in the run queue
+    return RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
+  }
   RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
   for (size_t i = 0; i < array_len(rinfo->dagOps); i++) {
     RAI_DagOp *currentOp = rinfo->dagOps[i];
@@ -215,7 +220,6 @@ int RedisAI_DagRun_Reply(RedisModuleCtx *ctx, RedisModuleString **argv,
   }
   AI_dictReleaseIterator(persist_iter);
   RedisModule_ReplySetArrayLength(ctx, rinfo->dagReplyLength);
-  RAI_FreeRunInfo(ctx, rinfo);
   return REDISMODULE_OK;
 }
 
@@ -10,8 +10,8 @@
 /**
  * Actual method running the DAGRUN Commands in the background
  * thread Called within `RedisAI_Run_ThreadMain`
- * After all computation is done, this will trigger
- * the reply callback to be called in order to reply to the client.
+ * Once all computation is done, the completion thread of the run queue
+ * unblocks the client, which triggers the reply callback.
  * The 'rinfo' argument will be accessible by the reply callback.
  *
  * @param rinfo context in which RedisAI blocking commands operate.
@@ -20,8 +20,8 @@
 void *RedisAI_DagRunSession(RedisAI_RunInfo *rinfo);
 
 /**
- * Reply Callback called after a successful RedisModule_UnblockClient() within
- * RedisAI_DagRunSession() in order to reply to the client and unblock it
+ * Reply Callback called after a successful RedisModule_UnblockClient() once
+ * RedisAI_DagRunSession() is done, in order to reply to the client and unblock it
  *
  * @param ctx Context in which Redis modules operate
  * @param argv Redis command arguments, as an array of strings
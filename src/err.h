@@ -19,6 +19,8 @@ typedef enum {
   RAI_ETENSORSET,
   RAI_ETENSORGET,
   RAI_EDAGRUN,
+  RAI_ETIMEDOUT,
+  RAI_EBUSY,
 } RAI_ErrorCode;
 
 typedef struct RAI_Error {
@@ -3,6 +3,7 @@
 #include <torch/csrc/jit/import.h>
 #include <torch/csrc/jit/script/compilation_unit.h>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 #include <ATen/Functions.h>
@@ -291,6 +292,26 @@ extern "C" DLManagedTensor* torchNewTensor(DLDataType dtype, long ndims, int64_t
   return dl_tensor;
 }
 
+extern "C" void torchSetNumThreads(int64_t intra_op_threads, int64_t inter_op_threads)
+{
+  // The intra-op setting is per calling thread with OpenMP, so every worker
+  // applies it; the inter-op pool is process wide and can only be sized once.
+  static std::once_flag inter_op_flag;
+  try {
+    if (intra_op_threads > 0 && at::get_num_threads() != intra_op_threads) {
+      at::set_num_threads(intra_op_threads);
+    }
+    if (inter_op_threads > 0) {
+      std::call_once(inter_op_flag, [inter_op_threads]() {
+        at::set_num_interop_threads(inter_op_threads);
+      });
+    }
+  }
+  catch(std::exception& e) {
+    // the pools were already started with a different size, keep them
+  }
+}
+
 extern "C" void* torchCompileScript(const char* script, DLDeviceType device, int64_t device_id,
                                     char **error, void* (*alloc)(size_t))
 {
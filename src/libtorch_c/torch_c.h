@@ -29,6 +29,8 @@ void torchRunModel(void* modelCtx,
                    long nOutputs, DLManagedTensor** outputs,
                    char **error, void* (*alloc)(size_t));
 
+void torchSetNumThreads(int64_t intra_op_threads, int64_t inter_op_threads);
+
 void torchSerializeModel(void* modelCtx, char **buffer, size_t *len,
                          char **error, void* (*alloc)(size_t));
 
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include "model.h"
 #include "model_struct.h"
 #include "backends.h"
@@ -8,6 +11,7 @@
 #include "util/arr_rm_alloc.h"
 #include "util/dict.h"
 #include "run_info.h"
+#include "background_workers.h"
 
 RedisModuleType *RedisAI_ModelType = NULL;
 
@@ -25,6 +29,76 @@ static void* RAI_Model_RdbLoad(struct RedisModuleIO *io, int encver) {
 
   const size_t batchsize = RedisModule_LoadUnsigned(io);
   const size_t minbatchsize = RedisModule_LoadUnsigned(io);
+  size_t batchtimeout = 0;
+  if (encver >= 1) {
+    batchtimeout = RedisModule_LoadUnsigned(io);
+  }
+  size_t nsessions = 1;
+  if (encver >= 2) {
+    nsessions = RedisModule_LoadUnsigned(io);
+  }
+  size_t targetlatency = 0;
+  if (encver >= 3) {
+    targetlatency = RedisModule_LoadUnsigned(io);
+  }
+  size_t npadbuckets = 0;
+  size_t padbuckets[RAI_MODEL_MAX_PADBUCKETS] = {0};
+  double padvalue = 0;
+  if (encver >= 4) {
+    npadbuckets = RedisModule_LoadUnsigned(io);
+    if (npadbuckets > RAI_MODEL_MAX_PADBUCKETS) {
+      RedisModule_LogIOError(io, "error", "Invalid number of PADBUCKETS: %zu", npadbuckets);
+      RedisModule_Free((void*)devicestr);
+      RedisModule_Free((void*)tag);
+      return NULL;
+    }
+    for (size_t i=0; i<npadbuckets; i++) {
+      padbuckets[i] = RedisModule_LoadUnsigned(io);
+      if (padbuckets[i] == 0 || (i > 0 && padbuckets[i] <= padbuckets[i-1])) {
+        RedisModule_LogIOError(io, "error", "PADBUCKETS must be positive and strictly ascending");
+        RedisModule_Free((void*)devicestr);
+        RedisModule_Free((void*)tag);
+        return NULL;
+      }
+    }
+    padvalue = RedisModule_LoadDouble(io);
+  }
+  size_t npadoutputs = 0;
+  size_t padoutputs[RAI_MODEL_MAX_PADOUTPUTS] = {0};
+  if (encver >= 8) {
+    npadoutputs = RedisModule_LoadUnsigned(io);
+    if (npadoutputs > RAI_MODEL_MAX_PADOUTPUTS) {
+      RedisModule_LogIOError(io, "error", "Invalid number of PADOUTPUTS: %zu", npadoutputs);
+      RedisModule_Free((void*)devicestr);
+      RedisModule_Free((void*)tag);
+      return NULL;
+    }
+    for (size_t i=0; i<npadoutputs; i++) {
+      padoutputs[i] = RedisModule_LoadUnsigned(io);
+      if (i > 0 && padoutputs[i] <= padoutputs[i-1]) {
+        RedisModule_LogIOError(io, "error", "PADOUTPUTS must be strictly ascending");
+        RedisModule_Free((void*)devicestr);
+        RedisModule_Free((void*)tag);
+        return NULL;
+      }
+    }
+  }
+  size_t cachesize = 0;
+  if (encver >= 5) {
+    cachesize = RedisModule_LoadUnsigned(io);
+  }
+  size_t weight = 1;
+  if (encver >= 6) {
+    weight = RedisModule_LoadUnsigned(io);
+    if (weight == 0 || weight > REDISAI_MAX_WEIGHT) {
+      RedisModule_LogIOError(io, "warning", "Invalid WEIGHT %zu, using 1", weight);
+      weight = 1;
+    }
+  }
+  size_t maxruntime = 0;
+  if (encver >= 7) {
+    maxruntime = RedisModule_LoadUnsigned(io);
+  }
 
   const size_t ninputs = RedisModule_LoadUnsigned(io);
   const char **inputs = RedisModule_Alloc(ninputs * sizeof(char*));
@@ -44,9 +118,20 @@ static void* RAI_Model_RdbLoad(struct RedisModuleIO *io, int encver) {
   RAI_ModelOpts opts = {
     .batchsize = batchsize,
     .minbatchsize = minbatchsize,
+    .batchtimeout = batchtimeout,
+    .nsessions = nsessions,
+    .targetlatency = targetlatency,
+    .npadbuckets = npadbuckets,
+    .padvalue = padvalue,
+    .npadoutputs = npadoutputs,
+    .cachesize = cachesize,
+    .weight = weight,
+    .maxruntime = maxruntime,
     .backends_intra_op_parallelism = getBackendsIntraOpParallelism(),
     .backends_inter_op_parallelism = getBackendsInterOpParallelism(),
   };
+  memcpy(opts.padbuckets, padbuckets, sizeof(padbuckets));
+  memcpy(opts.padoutputs, padoutputs, sizeof(padoutputs));
 
   size_t len;
 
@@ -89,6 +174,7 @@ static void* RAI_Model_RdbLoad(struct RedisModuleIO *io, int encver) {
   const char* stats_tag = RedisModule_Strdup(tag);
 
   model->infokey = RAI_AddStatsEntry(stats_ctx, stats_keystr, RAI_MODEL, backend, stats_devicestr, stats_tag);
+  runQueuesAddTenantKey(model->tag, model->infokey, model->opts.weight);
 
   RedisModule_Free(stats_keystr);
 
@@ -117,6 +203,21 @@ static void RAI_Model_RdbSave(RedisModuleIO *io, void *value) {
   RedisModule_SaveStringBuffer(io, model->tag, strlen(model->tag) + 1);
   RedisModule_SaveUnsigned(io, model->opts.batchsize);
   RedisModule_SaveUnsigned(io, model->opts.minbatchsize);
+  RedisModule_SaveUnsigned(io, model->opts.batchtimeout);
+  RedisModule_SaveUnsigned(io, model->opts.nsessions);
+  RedisModule_SaveUnsigned(io, model->opts.targetlatency);
+  RedisModule_SaveUnsigned(io, model->opts.npadbuckets);
+  for (size_t i=0; i<model->opts.npadbuckets; i++) {
+    RedisModule_SaveUnsigned(io, model->opts.padbuckets[i]);
+  }
+  RedisModule_SaveDouble(io, model->opts.padvalue);
+  RedisModule_SaveUnsigned(io, model->opts.npadoutputs);
+  for (size_t i=0; i<model->opts.npadoutputs; i++) {
+    RedisModule_SaveUnsigned(io, model->opts.padoutputs[i]);
+  }
+  RedisModule_SaveUnsigned(io, model->opts.cachesize);
+  RedisModule_SaveUnsigned(io, model->opts.weight);
+  RedisModule_SaveUnsigned(io, model->opts.maxruntime);
   RedisModule_SaveUnsigned(io, model->ninputs);
   for (size_t i=0; i<model->ninputs; i++) {
     RedisModule_SaveStringBuffer(io, model->inputs[i], strlen(model->inputs[i]) + 1);
@@ -165,13 +266,36 @@ static void RAI_Model_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, voi
     array_append(outputs_, RedisModule_CreateString(ctx, model->outputs[i], strlen(model->outputs[i])));
   }
 
+  RedisModuleString **padbuckets_ = array_new(RedisModuleString*, model->opts.npadbuckets);
+
+  for (size_t i=0; i<model->opts.npadbuckets; i++) {
+    array_append(padbuckets_, RedisModule_CreateStringFromLongLong(ctx, model->opts.padbuckets[i]));
+  }
+
+  RedisModuleString *padvalue_ = RedisModule_CreateStringPrintf(ctx, "%.17g", model->opts.padvalue);
+
+  RedisModuleString **padoutputs_ = array_new(RedisModuleString*, model->opts.npadoutputs);
+
+  for (size_t i=0; i<model->opts.npadoutputs; i++) {
+    array_append(padoutputs_, RedisModule_CreateStringFromLongLong(ctx, model->opts.padoutputs[i]));
+  }
+
   const char* backendstr = RAI_BackendName(model->backend);
 
-  RedisModule_EmitAOF(aof, "AI.MODELSET", "slccclclcvcvb",
+  RedisModule_EmitAOF(aof, "AI.MODELSET", "scccclclclclcvcscvclclclclcvcvb",
                       key,
                       backendstr, model->devicestr, model->tag,
                       "BATCHSIZE", model->opts.batchsize,
                       "MINBATCHSIZE", model->opts.minbatchsize,
+                      "BATCHTIMEOUT", model->opts.batchtimeout,
+                      "TARGETLATENCY", model->opts.targetlatency,
+                      "PADBUCKETS", padbuckets_, model->opts.npadbuckets,
+                      "PADVALUE", padvalue_,
+                      "PADOUTPUTS", padoutputs_, model->opts.npadoutputs,
+                      "SESSIONS", model->opts.nsessions,
+                      "CACHE", model->opts.cachesize,
+                      "WEIGHT", model->opts.weight,
+                      "MAXRUNTIME", model->opts.maxruntime,
                       "INPUTS", inputs_, model->ninputs,
                       "OUTPUTS", outputs_, model->noutputs,
                       buffer, len);
@@ -191,6 +315,20 @@ static void RAI_Model_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, voi
   }
 
   array_free(outputs_);
+
+  for (size_t i=0; i<model->opts.npadbuckets; i++) {
+    RedisModule_FreeString(ctx, padbuckets_[i]);
+  }
+
+  array_free(padbuckets_);
+
+  RedisModule_FreeString(ctx, padvalue_);
+
+  for (size_t i=0; i<model->opts.npadoutputs; i++) {
+    RedisModule_FreeString(ctx, padoutputs_[i]);
+  }
+
+  array_free(padoutputs_);
 }
 
 
@@ -217,6 +355,8 @@ int RAI_GetModelFromKeyspace(RedisModuleCtx *ctx, RedisModuleString *keyName,
 
 // TODO: pass err in?
 static void RAI_Model_DTFree(void *value) {
+  RAI_Model *model = value;
+  runQueuesRemoveTenantKey(model->tag, model->infokey, model->opts.weight);
   RAI_Error err = {0};
   RAI_ModelFree(value, &err);
   if (err.code != RAI_OK) {
@@ -236,14 +376,246 @@ int RAI_ModelInit(RedisModuleCtx* ctx) {
       .digest = NULL
   };
 
-  RedisAI_ModelType = RedisModule_CreateDataType(ctx, "AI__MODEL", 0, &tmModel);
+  RedisAI_ModelType = RedisModule_CreateDataType(ctx, "AI__MODEL", RAI_MODEL_ENC_VER, &tmModel);
   return RedisAI_ModelType != NULL;
 }
 
-RAI_Model *RAI_ModelCreate(RAI_Backend backend, const char* devicestr, const char* tag, RAI_ModelOpts opts,
-                           size_t ninputs, const char **inputs,
-                           size_t noutputs, const char **outputs,
-                           const char *modeldef, size_t modellen, RAI_Error* err) {
+typedef struct RAI_ModelCacheEntry {
+  uint64_t hash;
+  RAI_Tensor **inputs;
+  size_t ninputs;
+  RAI_Tensor **outputs;
+  size_t noutputs;
+  size_t nbytes;
+  struct RAI_ModelCacheEntry *prev;
+  struct RAI_ModelCacheEntry *next;
+} RAI_ModelCacheEntry;
+
+static uint64_t Model_CacheHashCallback(const void *key) {
+  return ((const RAI_ModelCacheEntry *)key)->hash;
+}
+
+static int Model_CacheCompareCallback(void *privdata, const void *key1,
+                                      const void *key2) {
+  const RAI_ModelCacheEntry *e1 = key1;
+  const RAI_ModelCacheEntry *e2 = key2;
+  if (e1->hash != e2->hash || e1->ninputs != e2->ninputs) {
+    return 0;
+  }
+  for (size_t i = 0; i < e1->ninputs; i++) {
+    RAI_Tensor *t1 = e1->inputs[i];
+    RAI_Tensor *t2 = e2->inputs[i];
+    if (t1 == t2) {
+      continue;
+    }
+    const DLDataType dtype1 = RAI_TensorDataType(t1);
+    const DLDataType dtype2 = RAI_TensorDataType(t2);
+    const int ndims = RAI_TensorNumDims(t1);
+    if (dtype1.code != dtype2.code || dtype1.bits != dtype2.bits ||
+        ndims != RAI_TensorNumDims(t2)) {
+      return 0;
+    }
+    for (int d = 0; d < ndims; d++) {
+      if (RAI_TensorDim(t1, d) != RAI_TensorDim(t2, d)) {
+        return 0;
+      }
+    }
+    if (memcmp(RAI_TensorData(t1), RAI_TensorData(t2), RAI_TensorByteSize(t1)) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static AI_dictType Model_CacheDictType = {
+    .hashFunction = Model_CacheHashCallback,
+    .keyDup = NULL,
+    .valDup = NULL,
+    .keyCompare = Model_CacheCompareCallback,
+    .keyDestructor = NULL,
+    .valDestructor = NULL,
+};
+
+static RAI_ModelCache *Model_CacheCreate(size_t maxbytes) {
+  RAI_ModelCache *cache = RedisModule_Calloc(1, sizeof(*cache));
+  cache->entries = AI_dictCreate(&Model_CacheDictType, NULL);
+  cache->maxbytes = maxbytes;
+  return cache;
+}
+
+static void Model_CacheUnlink(RAI_ModelCache *cache, RAI_ModelCacheEntry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+static void Model_CacheLinkFront(RAI_ModelCache *cache, RAI_ModelCacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+static void Model_CacheEntryFree(RAI_ModelCacheEntry *entry) {
+  for (size_t i = 0; i < entry->ninputs; i++) {
+    RAI_TensorFree(entry->inputs[i]);
+  }
+  for (size_t i = 0; i < entry->noutputs; i++) {
+    if (entry->outputs[i]) {
+      RAI_TensorFree(entry->outputs[i]);
+    }
+  }
+  RedisModule_Free(entry->inputs);
+  RedisModule_Free(entry->outputs);
+  RedisModule_Free(entry);
+}
+
+static void Model_CacheFree(RAI_ModelCache *cache) {
+  RAI_ModelCacheEntry *entry = cache->head;
+  while (entry) {
+    RAI_ModelCacheEntry *next = entry->next;
+    Model_CacheEntryFree(entry);
+    entry = next;
+  }
+  AI_dictRelease(cache->entries);
+  RedisModule_Free(cache);
+}
+
+/* Feeds `len` bytes to the running hash of the inputs of a run. */
+static uint64_t Model_CacheHashBytes(uint64_t hash, const void *data, size_t len) {
+  const char *bytes = data;
+  do {
+    const int chunk = len > (1 << 30) ? (1 << 30) : (int)len;
+    hash ^= AI_dictGenHashFunction(bytes, chunk) + 0x9e3779b97f4a7c15ULL +
+            (hash << 6) + (hash >> 2);
+    bytes += chunk;
+    len -= chunk;
+  } while (len > 0);
+  return hash;
+}
+
+uint64_t RAI_ModelCacheHash(RAI_ModelRunCtx *mctx) {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < array_len(mctx->inputs); i++) {
+    RAI_Tensor *t = mctx->inputs[i].tensor;
+    const DLTensor *dl = &t->tensor.dl_tensor;
+    hash = Model_CacheHashBytes(hash, &dl->dtype, sizeof(dl->dtype));
+    hash = Model_CacheHashBytes(hash, dl->shape, dl->ndim * sizeof(*dl->shape));
+    hash = Model_CacheHashBytes(hash, RAI_TensorData(t), RAI_TensorByteSize(t));
+  }
+  return hash;
+}
+
+/* Finds the cache entry of the inputs of a run, if any. */
+static RAI_ModelCacheEntry *Model_CacheFind(RAI_ModelCache *cache,
+                                            RAI_ModelRunCtx *mctx, uint64_t hash) {
+  const size_t ninputs = array_len(mctx->inputs);
+  RAI_Tensor *inputs[ninputs + 1];
+  for (size_t i = 0; i < ninputs; i++) {
+    inputs[i] = mctx->inputs[i].tensor;
+  }
+  RAI_ModelCacheEntry probe = {.hash = hash, .inputs = inputs, .ninputs = ninputs};
+  AI_dictEntry *entry = AI_dictFind(cache->entries, &probe);
+  return entry ? AI_dictGetVal(entry) : NULL;
+}
+
+int RAI_ModelCacheGet(RAI_ModelRunCtx *mctx, uint64_t hash) {
+  RAI_ModelCache *cache = mctx->model->cache;
+  if (cache == NULL) {
+    return 0;
+  }
+
+  RAI_ModelCacheEntry *entry = Model_CacheFind(cache, mctx, hash);
+  if (entry == NULL || entry->noutputs != array_len(mctx->outputs)) {
+    cache->misses++;
+    return 0;
+  }
+
+  cache->hits++;
+  Model_CacheUnlink(cache, entry);
+  Model_CacheLinkFront(cache, entry);
+  for (size_t i = 0; i < entry->noutputs; i++) {
+    if (entry->outputs[i]) {
+      mctx->outputs[i].tensor = RAI_TensorGetShallowCopy(entry->outputs[i]);
+    }
+  }
+  return 1;
+}
+
+void RAI_ModelCachePut(RAI_ModelRunCtx *mctx, uint64_t hash) {
+  RAI_ModelCache *cache = mctx->model->cache;
+  if (cache == NULL) {
+    return;
+  }
+
+  RAI_ModelCacheEntry *entry = Model_CacheFind(cache, mctx, hash);
+  if (entry) {
+    Model_CacheUnlink(cache, entry);
+    Model_CacheLinkFront(cache, entry);
+    return;
+  }
+
+  const size_t ninputs = array_len(mctx->inputs);
+  const size_t noutputs = array_len(mctx->outputs);
+  size_t nbytes = sizeof(*entry);
+  for (size_t i = 0; i < ninputs; i++) {
+    nbytes += RAI_TensorByteSize(mctx->inputs[i].tensor);
+  }
+  for (size_t i = 0; i < noutputs; i++) {
+    if (mctx->outputs[i].tensor) {
+      nbytes += RAI_TensorByteSize(mctx->outputs[i].tensor);
+    }
+  }
+  if (nbytes > cache->maxbytes) {
+    return;
+  }
+
+  while (cache->nbytes + nbytes > cache->maxbytes) {
+    RAI_ModelCacheEntry *lru = cache->tail;
+    Model_CacheUnlink(cache, lru);
+    AI_dictDelete(cache->entries, lru);
+    cache->nbytes -= lru->nbytes;
+    cache->evictions++;
+    Model_CacheEntryFree(lru);
+  }
+
+  entry = RedisModule_Calloc(1, sizeof(*entry));
+  entry->hash = hash;
+  entry->ninputs = ninputs;
+  entry->inputs = RedisModule_Calloc(ninputs + 1, sizeof(RAI_Tensor *));
+  for (size_t i = 0; i < ninputs; i++) {
+    entry->inputs[i] = RAI_TensorGetShallowCopy(mctx->inputs[i].tensor);
+  }
+  entry->noutputs = noutputs;
+  entry->outputs = RedisModule_Calloc(noutputs + 1, sizeof(RAI_Tensor *));
+  for (size_t i = 0; i < noutputs; i++) {
+    if (mctx->outputs[i].tensor) {
+      entry->outputs[i] = RAI_TensorGetShallowCopy(mctx->outputs[i].tensor);
+    }
+  }
+  entry->nbytes = nbytes;
+  AI_dictAdd(cache->entries, entry, entry);
+  Model_CacheLinkFront(cache, entry);
+  cache->nbytes += nbytes;
+}
+
+static RAI_Model *Model_CreateSession(RAI_Backend backend, const char* devicestr, RAI_ModelOpts opts,
+                                     size_t ninputs, const char **inputs,
+                                     size_t noutputs, const char **outputs,
+                                     const char *modeldef, size_t modellen, RAI_Error* err) {
   RAI_Model *model;
   if (backend == RAI_BACKEND_TENSORFLOW) {
     if (!RAI_backends.tf.model_create_with_nodes) {
@@ -278,52 +650,147 @@ RAI_Model *RAI_ModelCreate(RAI_Backend backend, const char* devicestr, const cha
     return NULL;
   }
 
-  if (model) {
-    model->tag = RedisModule_Strdup(tag);
-  }
-
   return model;
 }
 
-void RAI_ModelFree(RAI_Model* model, RAI_Error* err) {
-  if (--model->refCount > 0){
-    return;
-  }
-
+static int Model_FreeSession(RAI_Model* model, RAI_Error* err) {
   if (model->backend == RAI_BACKEND_TENSORFLOW) {
     if (!RAI_backends.tf.model_free) {
       RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Backend not loaded: TF\n");
-      return;
+      return REDISMODULE_ERR;
     }
     RAI_backends.tf.model_free(model, err);
   }
   else if (model->backend == RAI_BACKEND_TFLITE) {
     if (!RAI_backends.tflite.model_free) {
       RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Backend not loaded: TFLITE");
-      return;
+      return REDISMODULE_ERR;
     }
     RAI_backends.tflite.model_free(model, err);
   }
   else if (model->backend == RAI_BACKEND_TORCH) {
     if (!RAI_backends.torch.model_free) {
       RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Backend not loaded: TORCH");
-      return;
+      return REDISMODULE_ERR;
     }
     RAI_backends.torch.model_free(model, err);
   }
   else if (model->backend == RAI_BACKEND_ONNXRUNTIME) {
     if (!RAI_backends.onnx.model_free) {
       RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Backend not loaded: ONNX");
-      return;
+      return REDISMODULE_ERR;
     }
     RAI_backends.onnx.model_free(model, err);
   }
   else {
     RAI_SetError(err, RAI_EUNSUPPORTEDBACKEND, "Unsupported backend\n");
+    return REDISMODULE_ERR;
+  }
+
+  if (model->input_specs) {
+    for (size_t i = 0; i < array_len(model->input_specs); i++) {
+      if (model->input_specs[i].dims) {
+        array_free(model->input_specs[i].dims);
+      }
+    }
+    array_free(model->input_specs);
+    model->input_specs = NULL;
+  }
+
+  return REDISMODULE_OK;
+}
+
+static void Model_FreeSessionPool(RAI_ModelSessionPool *pool, RAI_Error* err) {
+  for (size_t i = 0; i < array_len(pool->replicas); i++) {
+    if (Model_FreeSession(pool->replicas[i], err) == REDISMODULE_OK) {
+      RedisModule_Free(pool->replicas[i]);
+    }
+  }
+  array_free(pool->replicas);
+  array_free(pool->idle);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->idle_condition_var);
+  RedisModule_Free(pool);
+}
+
+RAI_Model *RAI_ModelCreate(RAI_Backend backend, const char* devicestr, const char* tag, RAI_ModelOpts opts,
+                           size_t ninputs, const char **inputs,
+                           size_t noutputs, const char **outputs,
+                           const char *modeldef, size_t modellen, RAI_Error* err) {
+  if (opts.nsessions == 0) {
+    opts.nsessions = 1;
+  }
+
+  RAI_Model *model = Model_CreateSession(backend, devicestr, opts, ninputs, inputs,
+                                         noutputs, outputs, modeldef, modellen, err);
+  if (model == NULL) {
+    return NULL;
+  }
+
+  model->tag = RedisModule_Strdup(tag);
+  pthread_mutex_init(&model->latency.mutex, NULL);
+  if (opts.cachesize > 0) {
+    model->cache = Model_CacheCreate(opts.cachesize);
+  }
+
+  // TFLite interpreters cannot be invoked concurrently, so runs always check
+  // out a session, even if there is only one
+  if (opts.nsessions == 1 && backend != RAI_BACKEND_TFLITE) {
+    return model;
+  }
+
+  RAI_ModelSessionPool *pool = RedisModule_Calloc(1, sizeof(*pool));
+  pool->replicas = array_new(RAI_Model*, opts.nsessions - 1);
+  pool->idle = array_new(RAI_Model*, opts.nsessions);
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->idle_condition_var, NULL);
+  model->pool = pool;
+
+  pool->idle = array_append(pool->idle, model);
+  for (size_t i = 1; i < opts.nsessions; i++) {
+    RAI_Model *replica = Model_CreateSession(backend, devicestr, opts, ninputs, inputs,
+                                             noutputs, outputs, modeldef, modellen, err);
+    if (replica == NULL) {
+      RAI_Error free_err = {0};
+      Model_FreeSessionPool(pool, &free_err);
+      Model_FreeSession(model, &free_err);
+      RAI_ClearError(&free_err);
+      pthread_mutex_destroy(&model->latency.mutex);
+      if (model->cache) {
+        Model_CacheFree(model->cache);
+      }
+      RedisModule_Free(model->tag);
+      RedisModule_Free(model);
+      return NULL;
+    }
+    replica->opts = model->opts;
+    pool->replicas = array_append(pool->replicas, replica);
+    pool->idle = array_append(pool->idle, replica);
+  }
+
+  return model;
+}
+
+void RAI_ModelFree(RAI_Model* model, RAI_Error* err) {
+  if (--model->refCount > 0){
+    return;
+  }
+
+  if (model->pool) {
+    Model_FreeSessionPool(model->pool, err);
+    model->pool = NULL;
+  }
+
+  if (Model_FreeSession(model, err) != REDISMODULE_OK) {
     return;
   }
 
   RedisModule_Free(model->tag);
+  pthread_mutex_destroy(&model->latency.mutex);
+  if (model->cache) {
+    Model_CacheFree(model->cache);
+    model->cache = NULL;
+  }
 
   RAI_RemoveStatsEntry(model->infokey);
 
@@ -401,13 +868,30 @@ void RAI_ModelRunCtxFree(RAI_ModelRunCtx* mctx) {
   RedisModule_Free(mctx);
 }
 
-int RAI_ModelRun(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
-  int ret;
-
-  if (array_len(mctxs) == 0) {
-    RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Nothing to run");
-    return REDISMODULE_ERR;
+/* Checks out an idle session of the model, waiting for one if they are all
+ * running. */
+static RAI_Model *Model_AcquireSession(RAI_Model *model) {
+  RAI_ModelSessionPool *pool = model->pool;
+  pthread_mutex_lock(&pool->mutex);
+  while (array_len(pool->idle) == 0) {
+    pthread_cond_wait(&pool->idle_condition_var, &pool->mutex);
   }
+  RAI_Model *session = pool->idle[array_len(pool->idle) - 1];
+  array_trimm_len(pool->idle, array_len(pool->idle) - 1);
+  pthread_mutex_unlock(&pool->mutex);
+  return session;
+}
+
+static void Model_ReleaseSession(RAI_Model *model, RAI_Model *session) {
+  RAI_ModelSessionPool *pool = model->pool;
+  pthread_mutex_lock(&pool->mutex);
+  pool->idle = array_append(pool->idle, session);
+  pthread_cond_signal(&pool->idle_condition_var);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+static int Model_RunSession(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
+  int ret;
 
   switch (mctxs[0]->model->backend) {
     case RAI_BACKEND_TENSORFLOW:
@@ -446,6 +930,411 @@ int RAI_ModelRun(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
   return ret;
 }
 
+long long RAI_ModelPadLength(RAI_Model *model, long long len) {
+  for (size_t i = 0; i < model->opts.npadbuckets; i++) {
+    if (len <= (long long)model->opts.padbuckets[i]) {
+      return model->opts.padbuckets[i];
+    }
+  }
+  return len;
+}
+
+/* Pads the inputs whose dimension 1 differs between the runs of a batch to
+ * their PADBUCKETS length, so that the backends can concatenate them. The
+ * inputs replaced are kept in `unpadded`, indexed by run then input, and
+ * `lengths` receives the length of each run's first padded input.
+ * Returns the length that input was padded to, 0 if nothing was padded. */
+static long long Model_PadBatch(RAI_ModelRunCtx** mctxs, RAI_Tensor** unpadded,
+                                long long* lengths) {
+  const size_t nbatches = array_len(mctxs);
+  const size_t ninputs = array_len(mctxs[0]->inputs);
+  RAI_Model *model = mctxs[0]->model;
+  long long padded_len = 0;
+
+  for (size_t i = 0; i < ninputs; i++) {
+    RAI_Tensor *t0 = mctxs[0]->inputs[i].tensor;
+    if (RAI_TensorNumDims(t0) < 2) {
+      continue;
+    }
+    int uneven = 0;
+    for (size_t b = 1; b < nbatches; b++) {
+      if (RAI_TensorDim(mctxs[b]->inputs[i].tensor, 1) != RAI_TensorDim(t0, 1)) {
+        uneven = 1;
+        break;
+      }
+    }
+    if (!uneven) {
+      continue;
+    }
+    const long long len = RAI_ModelPadLength(model, RAI_TensorDim(t0, 1));
+    for (size_t b = 0; b < nbatches; b++) {
+      RAI_Tensor *t = mctxs[b]->inputs[i].tensor;
+      if (padded_len == 0) {
+        lengths[b] = RAI_TensorDim(t, 1);
+      }
+      unpadded[b * ninputs + i] = t;
+      mctxs[b]->inputs[i].tensor = RAI_TensorCreateByPadding(t, len, model->opts.padvalue);
+    }
+    if (padded_len == 0) {
+      padded_len = len;
+    }
+  }
+
+  return padded_len;
+}
+
+/* Truncates the PADOUTPUTS outputs of a run, which carry the padded length in
+ * dimension 1, to the length of the run. */
+static void Model_NarrowOutputs(RAI_ModelRunCtx* mctx, long long len,
+                                long long padded_len) {
+  const RAI_ModelOpts *opts = &mctx->model->opts;
+  for (size_t i = 0; i < opts->npadoutputs; i++) {
+    const size_t o = opts->padoutputs[i];
+    if (o >= array_len(mctx->outputs)) {
+      break;
+    }
+    RAI_Tensor *t = mctx->outputs[o].tensor;
+    if (t && RAI_TensorNumDims(t) >= 2 && RAI_TensorDim(t, 1) == padded_len) {
+      mctx->outputs[o].tensor = RAI_TensorCreateByNarrowing(t, len);
+      RAI_TensorFree(t);
+    }
+  }
+}
+
+/* Puts back the inputs replaced by Model_PadBatch and, after a successful
+ * run, truncates the PADOUTPUTS outputs to the length of their run. */
+static void Model_UnpadBatch(RAI_ModelRunCtx** mctxs, RAI_Tensor** unpadded,
+                             const long long* lengths, long long padded_len,
+                             int ran) {
+  const size_t nbatches = array_len(mctxs);
+  const size_t ninputs = array_len(mctxs[0]->inputs);
+
+  for (size_t b = 0; b < nbatches; b++) {
+    for (size_t i = 0; i < ninputs; i++) {
+      if (unpadded[b * ninputs + i]) {
+        RAI_TensorFree(mctxs[b]->inputs[i].tensor);
+        mctxs[b]->inputs[i].tensor = unpadded[b * ninputs + i];
+      }
+    }
+    if (ran && lengths[b] != padded_len) {
+      Model_NarrowOutputs(mctxs[b], lengths[b], padded_len);
+    }
+  }
+}
+
+/* The length Model_PadBatch pads a batch to, 0 if it pads nothing, with the
+ * length of each run's first padded input in `lengths`. */
+static long long Model_BatchPadLength(RAI_ModelRunCtx** mctxs, long long* lengths) {
+  const size_t nbatches = array_len(mctxs);
+  const size_t ninputs = array_len(mctxs[0]->inputs);
+  RAI_Model *model = mctxs[0]->model;
+  if (nbatches == 1 || model->opts.npadbuckets == 0) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < ninputs; i++) {
+    RAI_Tensor *t0 = mctxs[0]->inputs[i].tensor;
+    if (RAI_TensorNumDims(t0) < 2) {
+      continue;
+    }
+    for (size_t b = 1; b < nbatches; b++) {
+      if (RAI_TensorDim(mctxs[b]->inputs[i].tensor, 1) != RAI_TensorDim(t0, 1)) {
+        for (size_t c = 0; c < nbatches; c++) {
+          lengths[c] = RAI_TensorDim(mctxs[c]->inputs[i].tensor, 1);
+        }
+        return RAI_ModelPadLength(model, RAI_TensorDim(t0, 1));
+      }
+    }
+  }
+  return 0;
+}
+
+/* Runs in flight of models with MAXRUNTIME, and the thread that expires them
+ * once past their deadline */
+static struct {
+  pthread_once_t once;
+  pthread_mutex_t mutex;
+  pthread_cond_t condition_var;
+  RAI_RunCancel **runs;
+} model_watchdog = {.once = PTHREAD_ONCE_INIT};
+
+static void *Model_WatchdogMain(void *arg) {
+#ifdef __APPLE__
+  pthread_setname_np("redisai_wdog");
+#else
+  pthread_setname_np(pthread_self(), "redisai_wdog");
+#endif
+  pthread_mutex_lock(&model_watchdog.mutex);
+  while (1) {
+    const long long now_us = ustime();
+    long long deadline_us = 0;
+    for (size_t i = 0; i < array_len(model_watchdog.runs); i++) {
+      RAI_RunCancel *run = model_watchdog.runs[i];
+      if (run->deadline_us <= now_us) {
+        RAI_RunCancelExpire(run);
+      } else if (deadline_us == 0 || run->deadline_us < deadline_us) {
+        deadline_us = run->deadline_us;
+      }
+    }
+    if (deadline_us == 0) {
+      pthread_cond_wait(&model_watchdog.condition_var, &model_watchdog.mutex);
+    } else {
+      struct timespec ts = {.tv_sec = deadline_us / 1000000,
+                            .tv_nsec = (deadline_us % 1000000) * 1000};
+      pthread_cond_timedwait(&model_watchdog.condition_var,
+                             &model_watchdog.mutex, &ts);
+    }
+  }
+  return NULL;
+}
+
+static void Model_WatchdogInit(void) {
+  pthread_mutex_init(&model_watchdog.mutex, NULL);
+  pthread_cond_init(&model_watchdog.condition_var, NULL);
+  model_watchdog.runs = array_new(RAI_RunCancel *, 16);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, Model_WatchdogMain, NULL) == 0) {
+    pthread_detach(thread);
+  }
+}
+
+static void Model_WatchdogAdd(RAI_RunCancel *run) {
+  pthread_once(&model_watchdog.once, Model_WatchdogInit);
+  pthread_mutex_lock(&model_watchdog.mutex);
+  model_watchdog.runs = array_append(model_watchdog.runs, run);
+  pthread_cond_signal(&model_watchdog.condition_var);
+  pthread_mutex_unlock(&model_watchdog.mutex);
+}
+
+static void Model_WatchdogRemove(RAI_RunCancel *run) {
+  pthread_mutex_lock(&model_watchdog.mutex);
+  const size_t nruns = array_len(model_watchdog.runs);
+  for (size_t i = 0; i < nruns; i++) {
+    if (model_watchdog.runs[i] == run) {
+      model_watchdog.runs[i] = model_watchdog.runs[nruns - 1];
+      array_trimm_len(model_watchdog.runs, nruns - 1);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&model_watchdog.mutex);
+}
+
+/* Runs a batch on the backend under the watch of the watchdog if the model has
+ * a MAXRUNTIME. A run that expires fails with a timeout error, whether the
+ * backend could abort it or it completed anyway. */
+static int Model_RunWatched(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
+  const size_t maxruntime = mctxs[0]->model->opts.maxruntime;
+  if (maxruntime == 0) {
+    return Model_RunSession(mctxs, err);
+  }
+
+  RAI_RunCancel cancel;
+  RAI_RunCancelInit(&cancel, ustime() + (long long)maxruntime * 1000);
+  Model_WatchdogAdd(&cancel);
+  mctxs[0]->cancel = &cancel;
+  int ret = Model_RunSession(mctxs, err);
+  mctxs[0]->cancel = NULL;
+  Model_WatchdogRemove(&cancel);
+
+  if (RAI_RunCancelExpired(&cancel)) {
+    for (size_t i = 0; i < array_len(mctxs); i++) {
+      for (size_t o = 0; o < array_len(mctxs[i]->outputs); o++) {
+        if (mctxs[i]->outputs[o].tensor) {
+          RAI_TensorFree(mctxs[i]->outputs[o].tensor);
+          mctxs[i]->outputs[o].tensor = NULL;
+        }
+      }
+    }
+    RAI_ClearError(err);
+    RAI_SetError(err, RAI_ETIMEDOUT, "ERR Model run exceeded MAXRUNTIME");
+    ret = REDISMODULE_ERR;
+  }
+  RAI_RunCancelDestroy(&cancel);
+
+  return ret;
+}
+
+// moves the copies counted by the backend during a run to the model, as the
+// run may have been made on one of its pooled sessions
+static void Model_AddFallbackCopies(RAI_Model* model, RAI_ModelRunCtx** mctxs) {
+  if (mctxs[0]->fallback_copies > 0) {
+    atomic_fetch_add(&model->fallback_copies, mctxs[0]->fallback_copies);
+    mctxs[0]->fallback_copies = 0;
+  }
+}
+
+static int Model_RunPooled(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
+  RAI_Model *model = mctxs[0]->model;
+  if (model->pool == NULL) {
+    const int ret = Model_RunWatched(mctxs, err);
+    Model_AddFallbackCopies(model, mctxs);
+    return ret;
+  }
+
+  // the batch only ever holds runs of the same model: point them to the
+  // checked out session for the duration of the run
+  RAI_Model *session = Model_AcquireSession(model);
+  for (size_t i = 0; i < array_len(mctxs); i++) {
+    mctxs[i]->model = session;
+  }
+  int ret = Model_RunWatched(mctxs, err);
+  for (size_t i = 0; i < array_len(mctxs); i++) {
+    mctxs[i]->model = model;
+  }
+  Model_ReleaseSession(model, session);
+  Model_AddFallbackCopies(model, mctxs);
+
+  return ret;
+}
+
+int RAI_ModelRun(RAI_ModelRunCtx** mctxs, RAI_Error* err) {
+  const size_t nbatches = array_len(mctxs);
+  if (nbatches == 0) {
+    RAI_SetError(err, RAI_EBACKENDNOTLOADED, "ERR Nothing to run");
+    return REDISMODULE_ERR;
+  }
+
+  if (nbatches == 1 || mctxs[0]->model->opts.npadbuckets == 0) {
+    return Model_RunPooled(mctxs, err);
+  }
+
+  const size_t ninputs = array_len(mctxs[0]->inputs);
+  RAI_Tensor* unpadded[nbatches * ninputs + 1];
+  long long lengths[nbatches];
+  memset(unpadded, 0, sizeof(unpadded));
+
+  const long long padded_len = Model_PadBatch(mctxs, unpadded, lengths);
+  int ret = Model_RunPooled(mctxs, err);
+  if (padded_len > 0) {
+    Model_UnpadBatch(mctxs, unpadded, lengths, padded_len, ret == REDISMODULE_OK);
+  }
+
+  return ret;
+}
+
+RAI_ModelRunCtx* RAI_ModelRunCtxCreateBatch(RAI_ModelRunCtx** mctxs) {
+  const size_t nbatches = array_len(mctxs);
+  const size_t ninputs = array_len(mctxs[0]->inputs);
+  const size_t noutputs = array_len(mctxs[0]->outputs);
+
+  RAI_Tensor* unpadded[nbatches * ninputs + 1];
+  long long lengths[nbatches];
+  memset(unpadded, 0, sizeof(unpadded));
+  long long padded_len = 0;
+  if (mctxs[0]->model->opts.npadbuckets > 0) {
+    padded_len = Model_PadBatch(mctxs, unpadded, lengths);
+  }
+
+  RAI_ModelRunCtx* batch = RedisModule_Calloc(1, sizeof(*batch));
+  // not a reference of its own: the runs hold the model until the batch is freed
+  batch->model = mctxs[0]->model;
+  batch->inputs = array_new(RAI_ModelCtxParam, ninputs);
+  batch->outputs = array_new(RAI_ModelCtxParam, noutputs);
+  for (size_t i = 0; i < ninputs; i++) {
+    RAI_Tensor* ts[nbatches];
+    for (size_t b = 0; b < nbatches; b++) {
+      ts[b] = mctxs[b]->inputs[i].tensor;
+    }
+    RAI_ModelCtxParam param = {
+        .name = mctxs[0]->inputs[i].name,
+        .tensor = RAI_TensorCreateByConcatenatingTensors(ts, nbatches),
+    };
+    batch->inputs = array_append(batch->inputs, param);
+  }
+  for (size_t o = 0; o < noutputs; o++) {
+    RAI_ModelCtxParam param = {.name = mctxs[0]->outputs[o].name, .tensor = NULL};
+    batch->outputs = array_append(batch->outputs, param);
+  }
+
+  if (padded_len > 0) {
+    Model_UnpadBatch(mctxs, unpadded, lengths, padded_len, 0);
+  }
+  return batch;
+}
+
+void RAI_ModelRunCtxSplitBatch(RAI_ModelRunCtx* batch, RAI_ModelRunCtx** mctxs) {
+  const size_t nbatches = array_len(mctxs);
+  long long lengths[nbatches];
+  const long long padded_len = Model_BatchPadLength(mctxs, lengths);
+
+  long long offset = 0;
+  for (size_t b = 0; b < nbatches; b++) {
+    const long long len = RAI_TensorDim(mctxs[b]->inputs[0].tensor, 0);
+    for (size_t o = 0; o < array_len(batch->outputs); o++) {
+      RAI_Tensor *t = batch->outputs[o].tensor;
+      if (t) {
+        mctxs[b]->outputs[o].tensor = RAI_TensorCreateBySlicingTensor(t, offset, len);
+      }
+    }
+    if (padded_len > 0 && lengths[b] != padded_len) {
+      Model_NarrowOutputs(mctxs[b], lengths[b], padded_len);
+    }
+    offset += len;
+  }
+}
+
+void RAI_ModelRunCtxFreeBatch(RAI_ModelRunCtx* batch) {
+  for (size_t i = 0; i < array_len(batch->inputs); i++) {
+    RAI_TensorFree(batch->inputs[i].tensor);
+  }
+  array_free(batch->inputs);
+  for (size_t o = 0; o < array_len(batch->outputs); o++) {
+    if (batch->outputs[o].tensor) {
+      RAI_TensorFree(batch->outputs[o].tensor);
+    }
+  }
+  array_free(batch->outputs);
+  RedisModule_Free(batch);
+}
+
+int RAI_ModelRunCtxValidateInputs(RAI_ModelRunCtx* mctx, RAI_Error* err) {
+  RAI_ModelInputSpec* specs = mctx->model->input_specs;
+  if (specs == NULL) {
+    return REDISMODULE_OK;
+  }
+
+  char msg[256];
+  const size_t ninputs = array_len(mctx->inputs);
+  if (ninputs != array_len(specs)) {
+    sprintf(msg, "ERR Expected %u inputs but got %zu", array_len(specs), ninputs);
+    RAI_SetError(err, RAI_EMODELRUN, msg);
+    return REDISMODULE_ERR;
+  }
+
+  for (size_t i = 0; i < ninputs; i++) {
+    RAI_Tensor* t = mctx->inputs[i].tensor;
+    const DLDataType dtype = RAI_TensorDataType(t);
+    if (specs[i].dtype.bits != 0 &&
+        (dtype.code != specs[i].dtype.code || dtype.bits != specs[i].dtype.bits)) {
+      sprintf(msg, "ERR Input %zu has the wrong type", i);
+      RAI_SetError(err, RAI_EMODELRUN, msg);
+      return REDISMODULE_ERR;
+    }
+
+    if (specs[i].dims == NULL) {
+      continue;
+    }
+    const int ndims = RAI_TensorNumDims(t);
+    if (ndims != array_len(specs[i].dims)) {
+      sprintf(msg, "ERR Input %zu has %d dimensions, expected %u", i, ndims,
+              array_len(specs[i].dims));
+      RAI_SetError(err, RAI_EMODELRUN, msg);
+      return REDISMODULE_ERR;
+    }
+    const int first = mctx->model->opts.npadbuckets > 0 ? 2 : 1;
+    for (int d = first; d < ndims; d++) {
+      if (specs[i].dims[d] >= 0 && RAI_TensorDim(t, d) != specs[i].dims[d]) {
+        sprintf(msg, "ERR Input %zu has size %lld in dimension %d, expected %lld", i,
+                RAI_TensorDim(t, d), d, (long long)specs[i].dims[d]);
+        RAI_SetError(err, RAI_EMODELRUN, msg);
+        return REDISMODULE_ERR;
+      }
+    }
+  }
+
+  return REDISMODULE_OK;
+}
+
 RAI_Model* RAI_ModelGetShallowCopy(RAI_Model* model) {
   ++model->refCount;
   return model;
@@ -492,8 +1381,148 @@ int RAI_ModelSerialize(RAI_Model *model, char **buffer, size_t *len, RAI_Error *
 }
 
 
+/* Weight of the latest measure in the moving averages of the latency curve */
+#define RAI_MODEL_LATENCY_WEIGHT 0.125
+
+static inline double latencyAverage(double average, double value) {
+  if (average == 0) {
+    return value;
+  }
+  return average + (value - average) * RAI_MODEL_LATENCY_WEIGHT;
+}
+
+static int latencyBucket(size_t batchsize) {
+  int bucket = 0;
+  while (batchsize > 1 && bucket < RAI_MODEL_LATENCY_BUCKETS - 1) {
+    batchsize >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void RAI_ModelAddRunLatency(RAI_Model *model, size_t batchsize, long long duration_us) {
+  if (batchsize == 0) {
+    return;
+  }
+  RAI_ModelLatency *latency = &model->latency;
+  const int bucket = latencyBucket(batchsize);
+  pthread_mutex_lock(&latency->mutex);
+  latency->batchsize[bucket] = latencyAverage(latency->batchsize[bucket], batchsize);
+  latency->run_us[bucket] =
+      latencyAverage(latency->run_us[bucket], duration_us > 0 ? duration_us : 1);
+  pthread_mutex_unlock(&latency->mutex);
+}
+
+void RAI_ModelAddArrival(RAI_Model *model, size_t nsamples, long long arrival_us) {
+  RAI_ModelLatency *latency = &model->latency;
+  pthread_mutex_lock(&latency->mutex);
+  if (latency->last_arrival_us > 0 && arrival_us > latency->last_arrival_us &&
+      nsamples > 0) {
+    const double interval_us =
+        (double)(arrival_us - latency->last_arrival_us) / nsamples;
+    latency->sample_interval_us = latencyAverage(latency->sample_interval_us, interval_us);
+  }
+  if (arrival_us > latency->last_arrival_us) {
+    latency->last_arrival_us = arrival_us;
+  }
+  pthread_mutex_unlock(&latency->mutex);
+}
+
+/* Interpolates the curve at `batchsize`. Below the smallest measured batch
+ * size the run time is taken as flat, above the largest one as proportional
+ * to the batch size. Called with the latency mutex held. */
+static double latencyEstimate(RAI_ModelLatency *latency, size_t batchsize) {
+  double prev_size = 0;
+  double prev_us = 0;
+  for (int i = 0; i < RAI_MODEL_LATENCY_BUCKETS; i++) {
+    if (latency->run_us[i] == 0) {
+      continue;
+    }
+    const double size = latency->batchsize[i];
+    const double run_us = latency->run_us[i];
+    if (batchsize <= size) {
+      if (prev_size == 0 || size <= prev_size) {
+        return run_us;
+      }
+      return prev_us + (run_us - prev_us) * (batchsize - prev_size) / (size - prev_size);
+    }
+    prev_size = size;
+    prev_us = run_us;
+  }
+  if (prev_size == 0) {
+    return 0;
+  }
+  return prev_us * batchsize / prev_size;
+}
+
+long long RAI_ModelEstimatedRunTime(RAI_Model *model, size_t batchsize) {
+  pthread_mutex_lock(&model->latency.mutex);
+  const double run_us = latencyEstimate(&model->latency, batchsize);
+  pthread_mutex_unlock(&model->latency.mutex);
+  return (long long)run_us;
+}
+
+size_t RAI_ModelTargetBatchSize(RAI_Model *model) {
+  RAI_ModelLatency *latency = &model->latency;
+  const double target_us = (double)model->opts.targetlatency * 1000;
+
+  pthread_mutex_lock(&latency->mutex);
+  double largest = 0;
+  for (int i = 0; i < RAI_MODEL_LATENCY_BUCKETS; i++) {
+    if (latency->run_us[i] > 0 && latency->batchsize[i] > largest) {
+      largest = latency->batchsize[i];
+    }
+  }
+  size_t hi = largest > 0 ? (size_t)(2 * largest) : 1;
+  if (model->opts.batchsize > 0 && hi > model->opts.batchsize) {
+    hi = model->opts.batchsize;
+  }
+
+  // time to gather b samples and run them grows with b: bisect
+  size_t lo = 1;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo + 1) / 2;
+    const double total_us = latencyEstimate(latency, mid) +
+                            (mid - 1) * latency->sample_interval_us;
+    if (total_us <= target_us) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  latency->target_batchsize = lo;
+  pthread_mutex_unlock(&latency->mutex);
+
+  return lo;
+}
+
+void RAI_ModelReplyWithLatencyCurve(RedisModuleCtx *ctx, RAI_Model *model) {
+  RAI_ModelLatency *latency = &model->latency;
+  long long batchsize[RAI_MODEL_LATENCY_BUCKETS];
+  long long run_us[RAI_MODEL_LATENCY_BUCKETS];
+  long long npoints = 0;
+
+  pthread_mutex_lock(&latency->mutex);
+  for (int i = 0; i < RAI_MODEL_LATENCY_BUCKETS; i++) {
+    if (latency->run_us[i] > 0) {
+      batchsize[npoints] = (long long)(latency->batchsize[i] + 0.5);
+      run_us[npoints] = (long long)latency->run_us[i];
+      npoints++;
+    }
+  }
+  pthread_mutex_unlock(&latency->mutex);
+
+  RedisModule_ReplyWithArray(ctx, npoints);
+  for (long long i = 0; i < npoints; i++) {
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithLongLong(ctx, batchsize[i]);
+    RedisModule_ReplyWithLongLong(ctx, run_us[i]);
+  }
+}
+
 int RedisAI_Parse_ModelRun_RedisCommand(RedisModuleCtx *ctx,
                                         RedisModuleString **argv, int argc,
+                                        int inputs_argpos,
                                         // RedisAI_RunInfo **rinfo,
                                         RAI_ModelRunCtx **mctx,
                                         RedisModuleString ***outkeys,
@@ -501,7 +1530,7 @@ int RedisAI_Parse_ModelRun_RedisCommand(RedisModuleCtx *ctx,
                                         AI_dict **localContextDict, 
                                         int use_chaining_operator,
                                         const char *chaining_operator, RAI_Error *error) {
-  if (argc < 3) {
+  if (argc < inputs_argpos + 1) {
     if (ctx == NULL) {
       RAI_SetError(error, RAI_EMODELRUN,
                    "ERR wrong number of arguments for 'AI.MODELRUN' command");
@@ -511,7 +1540,7 @@ int RedisAI_Parse_ModelRun_RedisCommand(RedisModuleCtx *ctx,
     return -1;
   }
 
-  const char *inputstr = RedisModule_StringPtrLen(argv[2], NULL);
+  const char *inputstr = RedisModule_StringPtrLen(argv[inputs_argpos], NULL);
   if (strcasecmp(inputstr, "INPUTS")) {
     if (ctx == NULL) {
       RAI_SetError(error, RAI_EMODELRUN, "ERR INPUTS not specified");
@@ -526,7 +1555,7 @@ int RedisAI_Parse_ModelRun_RedisCommand(RedisModuleCtx *ctx,
   size_t ninputs = 0;
   size_t noutputs = 0;
   int outputs_flag_count = 0;
-  size_t argpos = 3;
+  size_t argpos = inputs_argpos + 1;
 
   for (; argpos <= argc - 1; argpos++) {
     const char *arg_string = RedisModule_StringPtrLen(argv[argpos], NULL);
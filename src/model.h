@@ -31,9 +31,136 @@ RAI_Tensor* RAI_ModelRunCtxInputTensor(RAI_ModelRunCtx* mctx, size_t index);
 RAI_Tensor* RAI_ModelRunCtxOutputTensor(RAI_ModelRunCtx* mctx, size_t index);
 
 int RAI_ModelRun(RAI_ModelRunCtx** mctxs, RAI_Error* err);
+
+/**
+ * Builds a run context holding the inputs of a batch of runs of the same
+ * model, concatenated along the batch dimension (and padded to their
+ * PADBUCKETS length first, if needed), so that the batch can be handed to
+ * RAI_ModelRun as a single run. Unlike RAI_ModelRunCtxCreate, the context
+ * does not take a reference to the model and can be used from any thread; the
+ * runs must outlive it.
+ *
+ * @param mctxs array of the run contexts to batch, at least one
+ * @return the batch context, to be freed with RAI_ModelRunCtxFreeBatch
+ */
+RAI_ModelRunCtx* RAI_ModelRunCtxCreateBatch(RAI_ModelRunCtx** mctxs);
+
+/**
+ * Slices the outputs of a batch context that ran back into the runs it was
+ * built from, truncating the PADOUTPUTS outputs to the length of each run.
+ * Outputs the batch does not have are left untouched.
+ *
+ * @param batch context built with RAI_ModelRunCtxCreateBatch
+ * @param mctxs the same array of run contexts the batch was built from
+ */
+void RAI_ModelRunCtxSplitBatch(RAI_ModelRunCtx* batch, RAI_ModelRunCtx** mctxs);
+
+/**
+ * Frees a context built with RAI_ModelRunCtxCreateBatch, along with its
+ * inputs and outputs.
+ *
+ * @param batch
+ */
+void RAI_ModelRunCtxFreeBatch(RAI_ModelRunCtx* batch);
+
+/**
+ * Checks the inputs of a run against the types and shapes declared by the
+ * model, if any. The batch dimension, and dimension 1 if PADBUCKETS is set,
+ * are not checked.
+ *
+ * @param mctx
+ * @param err error to set, with code RAI_EMODELRUN, if an input does not match
+ * @return REDISMODULE_OK if the inputs match the declaration, or if the model
+ * declares none, REDISMODULE_ERR otherwise
+ */
+int RAI_ModelRunCtxValidateInputs(RAI_ModelRunCtx* mctx, RAI_Error* err);
+
 RAI_Model* RAI_ModelGetShallowCopy(RAI_Model* model);
 
 int RAI_ModelSerialize(RAI_Model *model, char **buffer, size_t *len, RAI_Error *err);
+
+/**
+ * @param model
+ * @param len length of dimension 1 of an input
+ * @return the smallest PADBUCKETS length that is not smaller than `len`, or
+ * `len` itself if there is none
+ */
+long long RAI_ModelPadLength(RAI_Model *model, long long len);
+
+/**
+ * Adds a measured run to the latency curve of the model.
+ *
+ * @param model
+ * @param batchsize number of samples in the batch that ran
+ * @param duration_us run time of the batch
+ */
+void RAI_ModelAddRunLatency(RAI_Model *model, size_t batchsize, long long duration_us);
+
+/**
+ * Records the arrival of a request in the run queue, to estimate the rate at
+ * which samples of the model arrive.
+ *
+ * @param model
+ * @param nsamples batch size of the request
+ * @param arrival_us time at which the request was queued
+ */
+void RAI_ModelAddArrival(RAI_Model *model, size_t nsamples, long long arrival_us);
+
+/**
+ * @param model
+ * @param batchsize
+ * @return run time of a batch of the given size estimated from the latency
+ * curve, 0 if no run was measured yet
+ */
+long long RAI_ModelEstimatedRunTime(RAI_Model *model, size_t batchsize);
+
+/**
+ * Picks the largest batch size, up to BATCHSIZE, for which waiting for the
+ * batch to fill up at the current arrival rate and running it fits within
+ * TARGETLATENCY. Batch sizes up to twice the largest one measured so far are
+ * considered, so that the curve is explored gradually.
+ *
+ * @param model
+ * @return the batch size, at least 1
+ */
+size_t RAI_ModelTargetBatchSize(RAI_Model *model);
+
+/**
+ * Replies with the latency curve of the model, as an array of
+ * [batch size, run time in us] pairs ordered by batch size.
+ *
+ * @param ctx
+ * @param model
+ */
+void RAI_ModelReplyWithLatencyCurve(RedisModuleCtx *ctx, RAI_Model *model);
+
+/**
+ * @param mctx
+ * @return hash of the type, shape and data of the inputs of a run, to look
+ * it up in the result cache of the model
+ */
+uint64_t RAI_ModelCacheHash(RAI_ModelRunCtx *mctx);
+
+/**
+ * Looks up the outputs of a run in the result cache of its model. On a hit,
+ * the outputs of the run context are set to shallow copies of the cached
+ * outputs. Main thread only.
+ *
+ * @param mctx run context, inputs set and outputs not computed yet
+ * @param hash hash of the inputs, from RAI_ModelCacheHash
+ * @return 1 on a hit, 0 on a miss or if the model has no cache
+ */
+int RAI_ModelCacheGet(RAI_ModelRunCtx *mctx, uint64_t hash);
+
+/**
+ * Adds the inputs and outputs of a successful run to the result cache of its
+ * model, evicting the least recently used runs if the cache gets too large.
+ * Runs already in the cache are only marked as used. Main thread only.
+ *
+ * @param mctx run context, outputs computed
+ * @param hash hash of the inputs, from RAI_ModelCacheHash
+ */
+void RAI_ModelCachePut(RAI_ModelRunCtx *mctx, uint64_t hash);
 /* Return REDISMODULE_ERR if there was an error getting the Model.
  * Return REDISMODULE_OK if the model value stored at key was correctly
  * returned and available at *model variable. */
@@ -41,8 +168,12 @@ int RAI_GetModelFromKeyspace(RedisModuleCtx *ctx, RedisModuleString *keyName,
                               RedisModuleKey **key, RAI_Model **model,
                               int mode);
 
+/* Parses the INPUTS and OUTPUTS of AI.MODELRUN, INPUTS being found at
+ * argv[inputs_argpos]. Returns the position after the last argument parsed,
+ * or -1 on error. */
 int RedisAI_Parse_ModelRun_RedisCommand(RedisModuleCtx *ctx,
                                         RedisModuleString **argv, int argc,
+                                        int inputs_argpos,
                                         RAI_ModelRunCtx **mctx,
                                         RedisModuleString ***outkeys,
                                         RAI_Model **mto, int useLocalContext,
@@ -1,5 +1,6 @@
 #include "model_script_run_session.h"
 
+#include "background_workers.h"
 #include "model.h"
 #include "redisai.h"
 #include "rmutil/alloc.h"
@@ -13,78 +14,257 @@
 #include "util/queue.h"
 
 
+static void modelRunCtxClearOutputs(RAI_ModelRunCtx *mctx) {
+  for (size_t o = 0; o < RAI_ModelRunCtxNumOutputs(mctx); o++) {
+    if (mctx->outputs[o].tensor) {
+      RAI_TensorFree(mctx->outputs[o].tensor);
+      mctx->outputs[o].tensor = NULL;
+    }
+  }
+}
+
+/**
+ * Runs a batch of MODELRUN requests and records the outcome in each of them.
+ * If the batch fails, it is bisected and both halves are retried, so that a
+ * request the backend cannot run only fails itself rather than every request
+ * batched with it.
+ *
+ * @param batch_rinfo requests to run together
+ * @param batch_size number of requests
+ * @param elapsed_us time already spent on failed runs of the batch
+ */
+static void modelRunBatch(RedisAI_RunInfo **batch_rinfo, long long batch_size,
+                          long long elapsed_us) {
+  RAI_ModelRunCtx **mctxs = array_new(RAI_ModelRunCtx *, batch_size);
+  size_t nsamples = 0;
+  for (long long i = 0; i < batch_size; i++) {
+    mctxs = array_append(mctxs, batch_rinfo[i]->mctx);
+    nsamples += RAI_RunInfoBatchSize(batch_rinfo[i]);
+  }
+
+  RAI_Error *err;
+  RAI_InitError(&err);
+  const long long start = ustime();
+  const int status = RAI_ModelRun(mctxs, err);
+  const long long rtime = ustime() - start;
+  array_free(mctxs);
+
+  if (status == REDISMODULE_OK) {
+    RAI_ModelAddRunLatency(batch_rinfo[0]->mctx->model, nsamples, rtime);
+  } else if (batch_size > 1 && err->code != RAI_ETIMEDOUT) {
+    // a run aborted for exceeding MAXRUNTIME fails the whole batch: running
+    // the halves would likely hit it again
+    RAI_FreeError(err);
+    for (long long i = 0; i < batch_size; i++) {
+      modelRunCtxClearOutputs(batch_rinfo[i]->mctx);
+    }
+    const long long half = batch_size / 2;
+    modelRunBatch(batch_rinfo, half, elapsed_us + rtime);
+    modelRunBatch(batch_rinfo + half, batch_size - half, elapsed_us + rtime);
+    return;
+  }
+
+  for (long long i = 0; i < batch_size; i++) {
+    RedisAI_RunInfo *rinfo = batch_rinfo[i];
+    rinfo->result = status;
+    // TODO: add information on whether the call was batched
+    // and how large the batch was
+    rinfo->duration_us = elapsed_us + rtime;
+    if (status != REDISMODULE_OK) {
+      RAI_SetError(rinfo->err, err->code != RAI_OK ? err->code : RAI_EMODELRUN,
+                   err->detail);
+    }
+  }
+  RAI_FreeError(err);
+}
+
+/**
+ * Runs a batch of MODELRUN requests whose inputs were concatenated ahead of
+ * the run into `batch_mctx`, and records the outcome in each of them. The
+ * outputs stay in `batch_mctx` until RAI_ModelRunScriptRunComplete. If the
+ * batch fails, the requests are bisected as in modelRunBatch, unless it
+ * exceeded MAXRUNTIME.
+ */
+static void modelRunPreparedBatch(RedisAI_RunInfo **batch_rinfo,
+                                  RAI_ModelRunCtx *batch_mctx) {
+  const long long batch_size = array_len(batch_rinfo);
+  RAI_ModelRunCtx **mctxs = array_new(RAI_ModelRunCtx *, 1);
+  mctxs = array_append(mctxs, batch_mctx);
+
+  RAI_Error *err;
+  RAI_InitError(&err);
+  const long long start = ustime();
+  const int status = RAI_ModelRun(mctxs, err);
+  const long long rtime = ustime() - start;
+  array_free(mctxs);
+
+  if (status != REDISMODULE_OK && err->code == RAI_ETIMEDOUT) {
+    for (long long i = 0; i < batch_size; i++) {
+      batch_rinfo[i]->result = REDISMODULE_ERR;
+      batch_rinfo[i]->duration_us = rtime;
+      RAI_SetError(batch_rinfo[i]->err, err->code, err->detail);
+    }
+    RAI_FreeError(err);
+    return;
+  }
+  RAI_FreeError(err);
+
+  if (status != REDISMODULE_OK) {
+    modelRunCtxClearOutputs(batch_mctx);
+    const long long half = batch_size / 2;
+    modelRunBatch(batch_rinfo, half, rtime);
+    modelRunBatch(batch_rinfo + half, batch_size - half, rtime);
+    return;
+  }
+
+  size_t nsamples = 0;
+  for (long long i = 0; i < batch_size; i++) {
+    nsamples += RAI_RunInfoBatchSize(batch_rinfo[i]);
+    batch_rinfo[i]->result = REDISMODULE_OK;
+    batch_rinfo[i]->duration_us = rtime;
+  }
+  RAI_ModelAddRunLatency(batch_mctx->model, nsamples, rtime);
+}
+
+RAI_ModelRunCtx *RAI_ModelRunScriptRunPrepare(RedisAI_RunInfo **batch_rinfo) {
+  const long long batch_size = array_len(batch_rinfo);
+
+  if (batch_size == 0) {
+    return NULL;
+  }
+
+  if (batch_rinfo[0]->parent) {
+    // chunks always run alone
+    RAI_RunInfoSliceChunk(batch_rinfo[0]);
+  }
+
+  if (batch_size == 1 || batch_rinfo[0]->mctx == NULL) {
+    return NULL;
+  }
+
+  RAI_ModelRunCtx **mctxs = array_new(RAI_ModelRunCtx *, batch_size);
+  for (long long i = 0; i < batch_size; i++) {
+    mctxs = array_append(mctxs, batch_rinfo[i]->mctx);
+  }
+  RAI_ModelRunCtx *batch_mctx = RAI_ModelRunCtxCreateBatch(mctxs);
+  array_free(mctxs);
+  return batch_mctx;
+}
+
 /**
  * Actual method running the MODELRUN and SCRIPTRUN Commands in the background
  * thread Called within `RedisAI_Run_ThreadMain`
  */
-void *RAI_ModelRunScriptRunSession(RedisAI_RunInfo **batch_rinfo) {
+void *RAI_ModelRunScriptRunSession(RedisAI_RunInfo **batch_rinfo,
+                                   RAI_ModelRunCtx *batch_mctx) {
   const long long batch_size = array_len(batch_rinfo);
 
   if (batch_size == 0) {
     return NULL;
   }
 
-  RAI_ModelRunCtx **mctxs = NULL;
-  RAI_ScriptRunCtx *sctx = NULL;
+  if (batch_mctx) {
+    modelRunPreparedBatch(batch_rinfo, batch_mctx);
+  } else if (batch_rinfo[0]->mctx) {
+    modelRunBatch(batch_rinfo, batch_size, 0);
+  } else if (batch_rinfo[0]->sctx) {
+    // No batching for scripts for now
+    RedisAI_RunInfo *rinfo = batch_rinfo[0];
+    const long long start = ustime();
+    rinfo->result = RAI_ScriptRun(rinfo->sctx, rinfo->err);
+    rinfo->duration_us = ustime() - start;
+  }
+
+  return NULL;
+}
+
+void RAI_ModelRunScriptRunComplete(RedisAI_RunInfo **batch_rinfo,
+                                   RAI_ModelRunCtx *batch_mctx) {
+  const long long batch_size = array_len(batch_rinfo);
 
-  RAI_Error *err = RedisModule_Calloc(1, sizeof(RAI_Error));
-  long long rtime;
-  int status;
-  if (batch_rinfo[0]->mctx) {
-    mctxs = array_new(RAI_ModelRunCtx *, batch_size);
+  if (batch_mctx) {
+    RAI_ModelRunCtx **mctxs = array_new(RAI_ModelRunCtx *, batch_size);
     for (long long i = 0; i < batch_size; i++) {
       mctxs = array_append(mctxs, batch_rinfo[i]->mctx);
     }
-  } else if (batch_rinfo[0]->sctx) {
-    sctx = batch_rinfo[0]->sctx;
-  }
-
-  const long long start = ustime();
-  if (mctxs) {
-    status = RAI_ModelRun(mctxs, err);
-  } else if (sctx) {
-    status = RAI_ScriptRun(sctx, err);
+    RAI_ModelRunCtxSplitBatch(batch_mctx, mctxs);
+    array_free(mctxs);
+    RAI_ModelRunCtxFreeBatch(batch_mctx);
   }
-  rtime = ustime() - start;
 
   for (long long i = 0; i < batch_size; i++) {
     struct RedisAI_RunInfo *rinfo = batch_rinfo[i];
+    if (rinfo->parent != NULL) {
+      RAI_ModelRunChunkDone(rinfo);
+    } else if (rinfo->client != NULL) {
+      RedisModule_UnblockClient(rinfo->client, rinfo);
+    }
+  }
+}
 
-    rinfo->result = status;
-    rinfo->err = RedisModule_Calloc(1, sizeof(RAI_Error));
-    // TODO: add information on whether the call was batched
-    // and how large the batch was
-    rinfo->duration_us = rtime;
+void RAI_ModelRunChunkDone(RedisAI_RunInfo *chunk) {
+  RedisAI_RunInfo *rinfo = chunk->parent;
+  if (atomic_fetch_sub(&rinfo->pending_chunks, 1) > 1) {
+    return;
+  }
 
-    rinfo->err->code = err->code;
-    if (err->code != RAI_OK) {
-      rinfo->err->detail = RedisModule_Strdup(err->detail);
-      rinfo->err->detail_oneline = RedisModule_Strdup(err->detail_oneline);
+  // all the chunks are done, and their results visible to us
+  const size_t nchunks = array_len(rinfo->chunks);
+  rinfo->result = REDISMODULE_OK;
+  rinfo->duration_us = 0;
+  rinfo->queue_wait_us = 0;
+  for (size_t c = 0; c < nchunks; c++) {
+    RedisAI_RunInfo *done = rinfo->chunks[c];
+    rinfo->duration_us += done->duration_us;
+    if (done->queue_wait_us > rinfo->queue_wait_us) {
+      rinfo->queue_wait_us = done->queue_wait_us;
     }
-    if (rinfo->client != NULL) {
-      RedisModule_UnblockClient(rinfo->client, rinfo);
+    if (done->result == REDISMODULE_ERR && rinfo->result == REDISMODULE_OK) {
+      rinfo->result = REDISMODULE_ERR;
+      RAI_SetError(rinfo->err, done->err->code,
+                   done->err->detail ? done->err->detail : "ERR Chunk failed");
     }
   }
 
-  if (mctxs) {
-    array_free(mctxs);
-  } else if (sctx) {
-    // No batching for scripts for now
+  if (rinfo->result == REDISMODULE_OK) {
+    for (size_t o = 0; o < RAI_ModelRunCtxNumOutputs(rinfo->mctx); o++) {
+      RAI_Tensor *outputs[nchunks];
+      int complete = 1;
+      for (size_t c = 0; c < nchunks; c++) {
+        outputs[c] = RAI_ModelRunCtxOutputTensor(rinfo->chunks[c]->mctx, o);
+        complete = complete && outputs[c] != NULL;
+      }
+      if (complete) {
+        rinfo->mctx->outputs[o].tensor =
+            RAI_TensorCreateByConcatenatingTensors(outputs, nchunks);
+      }
+    }
   }
 
-  return NULL;
+  if (rinfo->client != NULL) {
+    RedisModule_UnblockClient(rinfo->client, rinfo);
+  }
 }
 
 /**
  * Reply Callback called after a successful RedisModule_UnblockClient() within
- * RAI_ModelRunScriptRunSession() in order to reply to the client and unblock it
+ * RAI_ModelRunScriptRunComplete() in order to reply to the client and unblock it
  */
 int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
                                int argc) {
   REDISMODULE_NOT_USED(argv);
   REDISMODULE_NOT_USED(argc);
   struct RedisAI_RunInfo *rinfo = RedisModule_GetBlockedClientPrivateData(ctx);
+  if (atomic_load(&rinfo->cancelled)) {
+    // the client is gone, don't store its outputs
+    return REDISMODULE_OK;
+  }
+
+  return RAI_ModelRunScriptRunReplyWithInfo(ctx, rinfo);
+}
 
+int RAI_ModelRunScriptRunReplyWithInfo(RedisModuleCtx *ctx,
+                                       RedisAI_RunInfo *rinfo) {
   const char *runkey = RedisModule_StringPtrLen(rinfo->runkey, NULL);
   AI_dictEntry *stats_entry = AI_dictFind(run_stats, runkey);
 
@@ -99,9 +279,7 @@ int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
       rstats->calls += 1;
       rstats->nerrors += 1;
     }
-    int ret = RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
-    RAI_FreeRunInfo(ctx, rinfo);
-    return ret;
+    return RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
   }
 
   size_t num_outputs = 0;
@@ -118,7 +296,6 @@ int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
     const int status = RAI_OpenKey_Tensor(ctx, rinfo->outkeys[i], &outkey,
                                           REDISMODULE_READ | REDISMODULE_WRITE);
     if (status == REDISMODULE_ERR) {
-      RAI_FreeRunInfo(ctx, rinfo);
       if (rstats) {
         rstats->calls += 1;
         rstats->nerrors += 1;
@@ -147,6 +324,7 @@ int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
 
   if (rstats) {
     rstats->duration_us += rinfo->duration_us;
+    rstats->queue_wait_us += rinfo->queue_wait_us;
     rstats->calls += 1;
 
     if (rinfo->mctx) {
@@ -154,18 +332,34 @@ int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
     }
   }
 
-  RAI_FreeRunInfo(ctx, rinfo);
+  if (rinfo->mctx) {
+    RAI_ModelCachePut(rinfo->mctx, rinfo->cache_hash);
+  }
+
   return RedisModule_ReplyWithSimpleString(ctx, "OK");
 }
 
 /**
  * Called in order to free the private data that is passed
  * by RedisModule_UnblockClient() call after
- * RAI_ModelRunScriptRunSession()
+ * RAI_ModelRunScriptRunComplete() or a DAGRUN. Redis calls it
+ * whether or not the reply callback ran, i.e. also when the client
+ * disconnected in the meantime.
  */
-void RedisAI_FreeData(RedisModuleCtx *ctx, void *rinfo) {}
+void RedisAI_FreeData(RedisModuleCtx *ctx, void *privdata) {
+  RedisAI_RunInfo *rinfo = privdata;
+  runQueueComplete(rinfo);
+  runQueueUntrack(rinfo);
+  RAI_FreeRunInfo(ctx, rinfo);
+}
 
+/**
+ * Called when a client disconnects while blocked on a run command. The
+ * request is flagged as cancelled, so that it is dropped from the run queue
+ * instead of being computed for nobody.
+ */
 void RedisAI_Disconnected(RedisModuleCtx *ctx, RedisModuleBlockedClient *bc) {
-  RedisModule_Log(ctx, "warning", "Blocked client %p disconnected!",
+  RedisModule_Log(ctx, "verbose", "Blocked client %p disconnected",
                   (void *)bc);
+  runQueueCancelClient(bc);
 }
\ No newline at end of file
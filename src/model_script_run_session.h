@@ -15,22 +15,56 @@
 
 
 
+/**
+ * Prepares a batch of MODELRUN or SCRIPTRUN commands to run, on the batcher
+ * thread of the run queue: slices the inputs of a chunk of a split MODELRUN,
+ * and concatenates the inputs of a MODELRUN batch of several requests, so
+ * that the run itself doesn't wait on copying.
+ *
+ * @param batch_rinfo array of `RedisAI_RunInfo *rinfo` contexts in which RedisAI blocking commands operate.
+ * @return the run context of the concatenated inputs, or NULL if the requests
+ * run with their own
+ */
+RAI_ModelRunCtx *RAI_ModelRunScriptRunPrepare(RedisAI_RunInfo **batch_rinfo);
+
 /**
  * Actual method running the MODELRUN and SCRIPTRUN Commands in the background
  * thread Called within `RedisAI_Run_ThreadMain`
- * After all computation is done, this will trigger
- * the reply callbacks to be called in order to reply to the clients.
- * The 'rinfo' argument will be accessible by the reply callback, for each of
- * the runinfo present in batch_rinfo
+ * The outcome is recorded in each of the contexts, and handed to the clients
+ * by RAI_ModelRunScriptRunComplete.
  *
  * @param batch_rinfo array of `RedisAI_RunInfo *rinfo` contexts in which RedisAI blocking commands operate.
+ * @param batch_mctx context returned by RAI_ModelRunScriptRunPrepare
  * @return
  */
-void *RAI_ModelRunScriptRunSession(RedisAI_RunInfo **batch_rinfo);
+void *RAI_ModelRunScriptRunSession(RedisAI_RunInfo **batch_rinfo,
+                                   RAI_ModelRunCtx *batch_mctx);
+
+/**
+ * Completes a batch that ran, on the completion thread of the run queue:
+ * slices the outputs of a concatenated batch back into its requests and
+ * frees `batch_mctx`, then unblocks the clients, which triggers the reply
+ * callbacks. The 'rinfo' argument will be accessible by the reply callback,
+ * for each of the runinfo present in batch_rinfo
+ *
+ * @param batch_rinfo array of `RedisAI_RunInfo *rinfo` contexts in which RedisAI blocking commands operate.
+ * @param batch_mctx context returned by RAI_ModelRunScriptRunPrepare
+ */
+void RAI_ModelRunScriptRunComplete(RedisAI_RunInfo **batch_rinfo,
+                                   RAI_ModelRunCtx *batch_mctx);
+
+/**
+ * Called by the completion thread once a chunk of a split MODELRUN has run or has been
+ * dropped. The last chunk of the request concatenates the outputs of all the
+ * chunks into the outputs of the request and unblocks its client.
+ *
+ * @param chunk one of the chunks created by RAI_RunInfoSplit
+ */
+void RAI_ModelRunChunkDone(RedisAI_RunInfo *chunk);
 
 /**
  * Reply Callback called after a successful RedisModule_UnblockClient() within
- * RAI_ModelRunScriptRunSession() in order to reply to the client and unblock it
+ * RAI_ModelRunScriptRunComplete() in order to reply to the client and unblock it
  *
  * @param ctx Context in which Redis modules operate
  * @param argv Redis command arguments, as an array of strings
@@ -40,17 +74,31 @@ void *RAI_ModelRunScriptRunSession(RedisAI_RunInfo **batch_rinfo);
 int RAI_ModelRunScriptRunReply(RedisModuleCtx *ctx, RedisModuleString **argv,
                                int argc);
 
+/**
+ * Replies to a MODELRUN or SCRIPTRUN with the outcome of the run, storing its
+ * outputs in the output keys. Used by RAI_ModelRunScriptRunReply, and by
+ * MODELRUN directly when the outputs are found in the result cache.
+ *
+ * @param ctx Context in which Redis modules operate
+ * @param rinfo context of the command, after the run
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR  if the MODELRUN/SCRIPTRUN failed
+ */
+int RAI_ModelRunScriptRunReplyWithInfo(RedisModuleCtx *ctx,
+                                       RedisAI_RunInfo *rinfo);
+
 /**
  * Called in order to free the private data that is passed
  * by RedisModule_UnblockClient() call after
- * RAI_ModelRunScriptRunSession()
+ * RAI_ModelRunScriptRunComplete()
  *
  * @param ctx Context in which Redis modules operate
- * @param rinfo
+ * @param privdata the `RedisAI_RunInfo *rinfo` of the blocked command
  */
-void RedisAI_FreeData(RedisModuleCtx *ctx, void *rinfo);
+void RedisAI_FreeData(RedisModuleCtx *ctx, void *privdata);
 
 /**
+ * Disconnect callback of the blocked run commands, cancels the pending
+ * request of the client.
  *
  * @param ctx Context in which Redis modules operate
  * @param bc
@@ -1,12 +1,37 @@
 #ifndef SRC_MODEL_STRUCT_H_
 #define SRC_MODEL_STRUCT_H_
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "config.h"
 #include "tensor_struct.h"
+#include "util/dict.h"
+
+/* Maximum number of lengths given to PADBUCKETS */
+#define RAI_MODEL_MAX_PADBUCKETS 16
+/* Maximum number of outputs given to PADOUTPUTS */
+#define RAI_MODEL_MAX_PADOUTPUTS 16
 
 typedef struct RAI_ModelOpts {
   size_t batchsize;
   size_t minbatchsize;
+  size_t batchtimeout;  //  ms after which a partial batch is run anyway
+  size_t nsessions;     //  number of backend sessions able to run concurrently
+  size_t targetlatency;  //  ms, if set the batch size is chosen to meet it
+  size_t padbuckets[RAI_MODEL_MAX_PADBUCKETS];  //  ascending lengths to which
+                                                //  dimension 1 of the inputs
+                                                //  is padded when batching
+  size_t npadbuckets;
+  double padvalue;
+  size_t padoutputs[RAI_MODEL_MAX_PADOUTPUTS];  //  ascending positions of the
+                                                //  outputs narrowed back to
+                                                //  the length of each run
+  size_t npadoutputs;
+  size_t cachesize;  //  bytes of inputs and outputs kept in the result cache
+  size_t weight;     //  share of the device run time, relative to the other
+                     //  tenants of the run queue (0 counts as 1)
+  size_t maxruntime;  //  ms after which a run is aborted, 0 if unbounded
   long long backends_intra_op_parallelism;  //  number of threads used within an
 //  individual op for parallelism.
 long long
@@ -14,21 +39,87 @@ long long
                                     //  between independent operations.
 } RAI_ModelOpts;
 
+/**
+ * Backend sessions of a model that workers check out, one per batch, so that
+ * several batches of the same model can run in parallel on backends whose
+ * sessions are not safe to run concurrently. The model's own session is part
+ * of the pool; the other ones are replicas created from the same definition.
+ */
+typedef struct RAI_ModelSessionPool {
+  struct RAI_Model **replicas;  // arr, sessions other than the model's own
+  struct RAI_Model **idle;      // arr, sessions not checked out
+  pthread_mutex_t mutex;
+  pthread_cond_t idle_condition_var;
+} RAI_ModelSessionPool;
+
+/* Number of batch size buckets of the latency curve, batch sizes from 2^i to
+ * 2^(i+1)-1 falling into bucket i */
+#define RAI_MODEL_LATENCY_BUCKETS 16
+
+/**
+ * Measured batch size -> run time curve of a model, used to pick batch sizes
+ * that meet TARGETLATENCY. Each bucket holds a moving average of the batch
+ * size and of the run time of the runs that fell into it; the curve is
+ * interpolated linearly between buckets. Updated by the workers after each
+ * run, under `mutex`.
+ */
+typedef struct RAI_ModelLatency {
+  pthread_mutex_t mutex;
+  double batchsize[RAI_MODEL_LATENCY_BUCKETS];
+  double run_us[RAI_MODEL_LATENCY_BUCKETS];  // 0 if no run measured yet
+  double sample_interval_us;  // moving average of the time between samples
+  long long last_arrival_us;
+  size_t target_batchsize;  // batch size last chosen to meet TARGETLATENCY
+} RAI_ModelLatency;
+
+/**
+ * Result cache of a model, enabled with CACHE: outputs of past runs, by
+ * content of the inputs. `entries` indexes the runs by a hash of the type,
+ * shape and data of their inputs, and the entries are linked from the most to
+ * the least recently used, the latter being evicted first once the inputs and
+ * outputs held exceed `maxbytes`. Only ever touched by the main thread.
+ */
+typedef struct RAI_ModelCache {
+  AI_dict *entries;
+  struct RAI_ModelCacheEntry *head;  // most recently used
+  struct RAI_ModelCacheEntry *tail;  // least recently used
+  size_t nbytes;
+  size_t maxbytes;
+  long long hits;
+  long long misses;
+  long long evictions;
+} RAI_ModelCache;
+
+/**
+ * Type and shape of a model input, as declared by the model definition. Set
+ * by the backends that can read them, and checked on MODELRUN before a
+ * request gets queued, so that a malformed request is rejected instead of
+ * failing the batch it would be run with.
+ */
+typedef struct RAI_ModelInputSpec {
+  DLDataType dtype;  // .bits is 0 if the type is not declared
+  int64_t *dims;     // arr, -1 for dimensions of any size, NULL if the shape
+                     // is not declared
+} RAI_ModelInputSpec;
+
 typedef struct RAI_Model {
   void* model;
-  // TODO: use session pool? The ideal would be to use one session per client.
-  //       If a client disconnects, we dispose the session or reuse it for
-  //       another client.
   void *session;
+  RAI_ModelSessionPool *pool;  //  NULL if the session is shared by all runs
+  RAI_ModelLatency latency;
+  RAI_ModelCache *cache;  //  NULL if CACHE is not set
   RAI_Backend backend;
   char* devicestr;
   char* tag;
   RAI_ModelOpts opts;
   char **inputs;
   size_t ninputs;
+  RAI_ModelInputSpec *input_specs;  // arr, NULL if the inputs are not declared
   char **outputs;
   size_t noutputs;
   long long refCount;
+  atomic_llong fallback_copies;  // inputs the backend had to copy because
+                                 // it could not use their data in place
   void* data;
   void* infokey;
 } RAI_Model;
@@ -43,6 +134,9 @@ typedef struct RAI_ModelRunCtx {
   RAI_Model* model;
   RAI_ModelCtxParam* inputs;
   RAI_ModelCtxParam* outputs;
+  struct RAI_RunCancel* cancel;  // set while a run with MAXRUNTIME is in the
+                                 // backend, see RAI_RunCancel
+  long long fallback_copies;     // counted by the backend during a run
 } RAI_ModelRunCtx;
 
 #endif /* SRC_MODEL_STRUCT_H_ */
@@ -85,7 +85,7 @@ int RedisAI_TensorGet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
 }
 
 /**
-* AI.MODELSET model_key backend device [TAG tag] [BATCHSIZE n [MINBATCHSIZE m]] [INPUTS name1 name2 ... OUTPUTS name1 name2 ...] model_blob
+* AI.MODELSET model_key backend device [TAG tag] [BATCHSIZE n [MINBATCHSIZE m] [BATCHTIMEOUT t] [TARGETLATENCY l] [PADBUCKETS len1 len2 ... [PADVALUE v] [PADOUTPUTS o1 o2 ...]]] [SESSIONS s] [CACHE bytes] [WEIGHT w] [MAXRUNTIME ms] [INPUTS name1 name2 ... OUTPUTS name1 name2 ...] model_blob
 */
 int RedisAI_ModelSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx);
@@ -149,6 +149,92 @@ int RedisAI_ModelSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
     }
   }
 
+  unsigned long long batchtimeout = 0;
+  if (AC_AdvanceIfMatch(&ac, "BATCHTIMEOUT")) {
+    if (AC_GetUnsignedLongLong(&ac, &batchtimeout, 0) != AC_OK) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for BATCHTIMEOUT");
+    }
+    if (batchtimeout > 0 && batchsize == 0) {
+      return RedisModule_ReplyWithError(ctx, "ERR BATCHTIMEOUT specified without BATCHSIZE");
+    }
+  }
+
+  unsigned long long targetlatency = 0;
+  if (AC_AdvanceIfMatch(&ac, "TARGETLATENCY")) {
+    if (AC_GetUnsignedLongLong(&ac, &targetlatency, 0) != AC_OK) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for TARGETLATENCY");
+    }
+    if (targetlatency > 0 && batchsize == 0) {
+      return RedisModule_ReplyWithError(ctx, "ERR TARGETLATENCY specified without BATCHSIZE");
+    }
+    if (targetlatency > 0 && (minbatchsize > 0 || batchtimeout > 0)) {
+      return RedisModule_ReplyWithError(ctx, "ERR TARGETLATENCY cannot be combined with MINBATCHSIZE or BATCHTIMEOUT");
+    }
+  }
+
+  size_t npadbuckets = 0;
+  size_t padbuckets[RAI_MODEL_MAX_PADBUCKETS];
+  double padvalue = 0;
+  size_t npadoutputs = 0;
+  size_t padoutputs[RAI_MODEL_MAX_PADOUTPUTS];
+  if (AC_AdvanceIfMatch(&ac, "PADBUCKETS")) {
+    unsigned long long len;
+    // the last argument is the model blob
+    while (AC_NumRemaining(&ac) > 1 && AC_GetUnsignedLongLong(&ac, &len, 0) == AC_OK) {
+      if (len == 0 || npadbuckets == RAI_MODEL_MAX_PADBUCKETS ||
+          (npadbuckets > 0 && len <= padbuckets[npadbuckets-1])) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for PADBUCKETS");
+      }
+      padbuckets[npadbuckets++] = len;
+    }
+    if (npadbuckets > 0 && batchsize == 0) {
+      return RedisModule_ReplyWithError(ctx, "ERR PADBUCKETS specified without BATCHSIZE");
+    }
+    if (AC_AdvanceIfMatch(&ac, "PADVALUE")) {
+      if (AC_GetDouble(&ac, &padvalue, 0) != AC_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for PADVALUE");
+      }
+    }
+    if (AC_AdvanceIfMatch(&ac, "PADOUTPUTS")) {
+      unsigned long long pos;
+      while (AC_NumRemaining(&ac) > 1 && AC_GetUnsignedLongLong(&ac, &pos, 0) == AC_OK) {
+        if (npadoutputs == RAI_MODEL_MAX_PADOUTPUTS ||
+            (npadoutputs > 0 && pos <= padoutputs[npadoutputs-1])) {
+          return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for PADOUTPUTS");
+        }
+        padoutputs[npadoutputs++] = pos;
+      }
+    }
+  }
+
+  unsigned long long nsessions = 1;
+  if (AC_AdvanceIfMatch(&ac, "SESSIONS")) {
+    if (AC_GetUnsignedLongLong(&ac, &nsessions, 0) != AC_OK || nsessions == 0) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for SESSIONS");
+    }
+  }
+
+  unsigned long long cachesize = 0;
+  if (AC_AdvanceIfMatch(&ac, "CACHE")) {
+    if (AC_GetUnsignedLongLong(&ac, &cachesize, 0) != AC_OK) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for CACHE");
+    }
+  }
+
+  unsigned long long weight = 1;
+  if (AC_AdvanceIfMatch(&ac, "WEIGHT")) {
+    if (AC_GetUnsignedLongLong(&ac, &weight, 0) != AC_OK || weight == 0 ||
+        weight > REDISAI_MAX_WEIGHT) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for WEIGHT");
+    }
+  }
+
+  unsigned long long maxruntime = 0;
+  if (AC_AdvanceIfMatch(&ac, "MAXRUNTIME")) {
+    if (AC_GetUnsignedLongLong(&ac, &maxruntime, 0) != AC_OK) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for MAXRUNTIME");
+    }
+  }
 
   if (AC_IsAtEnd(&ac)) {
     return RedisModule_ReplyWithError(ctx, "ERR Insufficient arguments, missing model BLOB");
@@ -195,9 +281,20 @@ int RedisAI_ModelSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
   RAI_ModelOpts opts = {
     .batchsize = batchsize,
     .minbatchsize = minbatchsize,
+    .batchtimeout = batchtimeout,
+    .nsessions = nsessions,
+    .targetlatency = targetlatency,
+    .npadbuckets = npadbuckets,
+    .padvalue = padvalue,
+    .npadoutputs = npadoutputs,
+    .cachesize = cachesize,
+    .weight = weight,
+    .maxruntime = maxruntime,
     .backends_intra_op_parallelism = getBackendsIntraOpParallelism(),
     .backends_inter_op_parallelism = getBackendsInterOpParallelism(),
   };
+  memcpy(opts.padbuckets, padbuckets, npadbuckets * sizeof(*padbuckets));
+  memcpy(opts.padoutputs, padoutputs, npadoutputs * sizeof(*padoutputs));
 
   RAI_Model *model = NULL;
 
@@ -268,6 +365,7 @@ int RedisAI_ModelSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
   RedisModule_ModuleTypeSetValue(key, RedisAI_ModelType, model);
 
   model->infokey = RAI_AddStatsEntry(ctx, keystr, RAI_MODEL, backend, devicestr, tag);
+  runQueuesAddTenantKey(model->tag, model->infokey, model->opts.weight);
 
   RedisModule_CloseKey(key);
 
@@ -393,7 +491,42 @@ int RedisAI_ModelList_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
 }
 
 /**
- * AI.MODELRUN model_key INPUTS input_key1 ... OUTPUTS output_key1 ...
+ * Parses the optional scheduling arguments shared by the run commands,
+ * [PRIORITY n] [TIMEOUT ms], given in any order.
+ *
+ * @param ctx Context in which Redis modules operate
+ * @param ac cursor positioned on the first optional argument, left on the
+ * first argument that is not a scheduling one
+ * @param rinfo context of the command being parsed
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR after replying with an
+ * error
+ */
+static int RedisAI_ParseRunQueueArgs(RedisModuleCtx *ctx, ArgsCursor *ac,
+                                     RedisAI_RunInfo *rinfo) {
+  while (!AC_IsAtEnd(ac)) {
+    if (AC_AdvanceIfMatch(ac, "PRIORITY")) {
+      long long priority;
+      if (AC_GetLongLong(ac, &priority, 0) != AC_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR Invalid argument for PRIORITY");
+        return REDISMODULE_ERR;
+      }
+      rinfo->priority = priority;
+    } else if (AC_AdvanceIfMatch(ac, "TIMEOUT")) {
+      unsigned long long timeout;
+      if (AC_GetUnsignedLongLong(ac, &timeout, AC_F_GE1) != AC_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR Invalid argument for TIMEOUT");
+        return REDISMODULE_ERR;
+      }
+      rinfo->deadline_us = ustime() + (long long)timeout * 1000;
+    } else {
+      break;
+    }
+  }
+  return REDISMODULE_OK;
+}
+
+/**
+ * AI.MODELRUN model_key [PRIORITY n] [TIMEOUT ms] INPUTS input_key1 ... OUTPUTS output_key1 ...
  *
  * The request is queued and evaded asynchronously from a separate thread. The
  * client blocks until the computation finishes.
@@ -430,33 +563,64 @@ int RedisAI_ModelRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
   rinfo->runkey = argv[1];
   rinfo->mctx = RAI_ModelRunCtxCreate(mto);
 
-  const int parse_result = RedisAI_Parse_ModelRun_RedisCommand(ctx, argv,
-                                   argc, &(rinfo->mctx), &(rinfo->outkeys), &mto, 0, NULL, 0, NULL, NULL);
+  // INPUTS follows the scheduling arguments
+  ArgsCursor ac;
+  ArgsCursor_InitRString(&ac, argv+2, argc-2);
+  if (RedisAI_ParseRunQueueArgs(ctx, &ac, rinfo) == REDISMODULE_ERR) {
+    RedisModule_CloseKey(modelKey);
+    RAI_FreeRunInfo(ctx,rinfo);
+    return REDISMODULE_ERR;
+  }
+  const int inputs_argpos = 2 + ac.offset;
+
+  const int parse_result = RedisAI_Parse_ModelRun_RedisCommand(ctx, argv, argc, inputs_argpos,
+                                   &(rinfo->mctx), &(rinfo->outkeys), &mto, 0, NULL, 0, NULL, NULL);
   RedisModule_CloseKey(modelKey);
   // if the number of parsed args is negative something went wrong
   if(parse_result<0){
     return REDISMODULE_ERR;
   }
 
+  // reject malformed inputs here, rather than let them fail a whole batch
+  if (RAI_ModelRunCtxValidateInputs(rinfo->mctx, rinfo->err) == REDISMODULE_ERR) {
+    const int ret = RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
+    RAI_FreeRunInfo(ctx,rinfo);
+    return ret;
+  }
+
+  if (mto->cache) {
+    rinfo->cache_hash = RAI_ModelCacheHash(rinfo->mctx);
+    if (RAI_ModelCacheGet(rinfo->mctx, rinfo->cache_hash)) {
+      rinfo->result = REDISMODULE_OK;
+      const int ret = RAI_ModelRunScriptRunReplyWithInfo(ctx, rinfo);
+      RAI_FreeRunInfo(ctx,rinfo);
+      return ret;
+    }
+  }
+
   RunQueueInfo *run_queue_info = NULL;
     // If the queue does not exist, initialize it
   if (ensureRunQueue(mto->devicestr,&run_queue_info) == REDISMODULE_ERR) {
     return RedisModule_ReplyWithError(ctx, "ERR Queue not initialized for device");
   }
 
+  if (runQueueAdmit(run_queue_info, rinfo->err) == REDISMODULE_ERR) {
+    RAI_AddRejectedRun(rinfo->runkey);
+    const int ret = RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
+    RAI_FreeRunInfo(ctx,rinfo);
+    return ret;
+  }
+
   rinfo->client = RedisModule_BlockClient(ctx, RAI_ModelRunScriptRunReply, NULL, RedisAI_FreeData, 0);
-  // RedisModule_SetDisconnectCallback(rinfo->client, RedisAI_Disconnected);
+  RedisModule_SetDisconnectCallback(rinfo->client, RedisAI_Disconnected);
 
-  pthread_mutex_lock(&run_queue_info->run_queue_mutex);
-  queuePush(run_queue_info->run_queue, rinfo);
-  pthread_cond_signal(&run_queue_info->queue_condition_var);
-  pthread_mutex_unlock(&run_queue_info->run_queue_mutex);
+  runQueuePush(run_queue_info, rinfo);
 
   return REDISMODULE_OK;
 }
 
 /** 
-* AI.SCRIPTRUN script_key fn_name INPUTS input_key1 ... OUTPUTS output_key1 ...
+* AI.SCRIPTRUN script_key fn_name [PRIORITY n] [TIMEOUT ms] INPUTS input_key1 ... OUTPUTS output_key1 ...
 */
 int RedisAI_ScriptRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   if (argc < 4) return RedisModule_WrongArity(ctx);
@@ -468,9 +632,15 @@ int RedisAI_ScriptRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
 
   if (RedisModule_IsKeysPositionRequest(ctx)) {
     RedisModule_KeyAtPos(ctx, 1);
+    int inputs_found = 0;
     for (int i=3; i<argc; i++) {
       const char* arg = RedisModule_StringPtrLen(argv[i], NULL);
+      if (!inputs_found && (strcasecmp(arg, "PRIORITY") == 0 || strcasecmp(arg, "TIMEOUT") == 0)) {
+        i++;
+        continue;
+      }
       if (strcasecmp(arg, "INPUTS") == 0 || strcasecmp(arg, "OUTPUTS") == 0) {
+        inputs_found = 1;
         continue;
       }
       RedisModule_KeyAtPos(ctx, i);
@@ -496,6 +666,12 @@ int RedisAI_ScriptRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
   const char* fnname;
   AC_GetString(&ac, &fnname, NULL, 0); 
 
+  if (RedisAI_ParseRunQueueArgs(ctx, &ac, rinfo) == REDISMODULE_ERR) {
+    RAI_FreeRunInfo(ctx,rinfo);
+    RedisModule_CloseKey(key);
+    return REDISMODULE_ERR;
+  }
+
   ArgsCursor inac = {0};
   ArgsCursor outac = {0};
 
@@ -562,13 +738,18 @@ int RedisAI_ScriptRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     return RedisModule_ReplyWithError(ctx, "ERR Queue not initialized for device");
   }
 
+  if (runQueueAdmit(run_queue_info, rinfo->err) == REDISMODULE_ERR) {
+    RAI_AddRejectedRun(rinfo->runkey);
+    const int ret = RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
+    RAI_FreeRunInfo(ctx,rinfo);
+    RedisModule_CloseKey(key);
+    return ret;
+  }
+
   rinfo->client = RedisModule_BlockClient(ctx, RAI_ModelRunScriptRunReply, NULL, RedisAI_FreeData, 0);
-  // RedisModule_SetDisconnectCallback(rinfo->client, RedisAI_Disconnected);
+  RedisModule_SetDisconnectCallback(rinfo->client, RedisAI_Disconnected);
 
-  pthread_mutex_lock(&run_queue_info->run_queue_mutex);
-  queuePush(run_queue_info->run_queue, rinfo);
-  pthread_cond_signal(&run_queue_info->queue_condition_var);
-  pthread_mutex_unlock(&run_queue_info->run_queue_mutex);
+  runQueuePush(run_queue_info, rinfo);
 
   RedisModule_ReplicateVerbatim(ctx);
   RedisModule_CloseKey(key);
@@ -622,12 +803,12 @@ int RedisAI_ScriptDel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
 }
 
 /** 
-* AI.SCRIPTSET script_key device [TAG tag] script_source
+* AI.SCRIPTSET script_key device [TAG tag] [WEIGHT w] script_source
 */
 int RedisAI_ScriptSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx);
 
-  if (argc != 4 && argc != 6) return RedisModule_WrongArity(ctx);
+  if (argc != 4 && argc != 6 && argc != 8) return RedisModule_WrongArity(ctx);
 
   ArgsCursor ac;
   ArgsCursor_InitRString(&ac, argv+1, argc-1);
@@ -643,6 +824,14 @@ int RedisAI_ScriptSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     AC_GetString(&ac, &tag, NULL, 0);
   }
 
+  long long weight = 1;
+  if (AC_AdvanceIfMatch(&ac, "WEIGHT")) {
+    if (AC_GetLongLong(&ac, &weight, 0) != AC_OK || weight <= 0 ||
+        weight > REDISAI_MAX_WEIGHT) {
+      return RedisModule_ReplyWithError(ctx, "ERR Invalid argument for WEIGHT");
+    }
+  }
+
   if (AC_IsAtEnd(&ac)) {
     return RedisModule_ReplyWithError(ctx, "Insufficient arguments, missing script definition");
   }
@@ -678,6 +867,8 @@ int RedisAI_ScriptSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     return ret;
   }
 
+  script->weight = weight;
+
   RunQueueInfo *run_queue_info = NULL;
   // If the queue does not exist, initialize it
   if (ensureRunQueue(devicestr,&run_queue_info) == REDISMODULE_ERR) {
@@ -706,6 +897,7 @@ int RedisAI_ScriptSet_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
   RedisModule_ModuleTypeSetValue(key, RedisAI_ScriptType, script);
 
   script->infokey = RAI_AddStatsEntry(ctx, keystr, RAI_SCRIPT, RAI_BACKEND_TORCH, devicestr, tag);
+  runQueuesAddTenantKey(script->tag, script->infokey, script->weight);
 
   RedisModule_CloseKey(key);
 
@@ -765,21 +957,56 @@ int RedisAI_Info_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
 
   struct RedisAI_RunStats *rstats = AI_dictGetVal(stats_entry);
 
+  RAI_Model *model = NULL;
+  RAI_Script *script = NULL;
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, rstats->key, REDISMODULE_READ);
+  if (rstats->type == RAI_MODEL &&
+      RedisModule_ModuleTypeGetType(key) == RedisAI_ModelType) {
+    model = RedisModule_ModuleTypeGetValue(key);
+  } else if (rstats->type == RAI_SCRIPT &&
+             RedisModule_ModuleTypeGetType(key) == RedisAI_ScriptType) {
+    script = RedisModule_ModuleTypeGetValue(key);
+  }
+
+  // runs of the key are accounted to its tenant on its device's run queue
+  const char *tenant_name = runQueueTenantName(rstats->tag, runkey);
+  RunTenant *tenant = NULL;
+  AI_dictEntry *queue_entry = AI_dictFind(run_queues, rstats->devicestr);
+  if (queue_entry) {
+    tenant = runQueueFindTenant(AI_dictGetVal(queue_entry), tenant_name);
+  }
+
   if (!AC_IsAtEnd(&ac)) {
     const char* opt;
     AC_GetString(&ac, &opt, NULL, 0); 
 
     if (strcasecmp(opt, "RESETSTAT") == 0) {
       rstats->duration_us = 0;
+      rstats->queue_wait_us = 0;
       rstats->samples = 0;
       rstats->calls = 0;
       rstats->nerrors = 0;
+      rstats->nrejected = 0;
+      if (model) {
+        atomic_store(&model->fallback_copies, 0);
+      }
+      if (model && model->cache) {
+        model->cache->hits = 0;
+        model->cache->misses = 0;
+        model->cache->evictions = 0;
+      }
+      if (tenant) {
+        atomic_store(&tenant->nruns, 0);
+        atomic_store(&tenant->wait_us, 0);
+        atomic_store(&tenant->max_wait_us, 0);
+        atomic_store(&tenant->run_us, 0);
+      }
       RedisModule_ReplyWithSimpleString(ctx, "OK");
       return REDISMODULE_OK;
     }
   }
 
-  RedisModule_ReplyWithArray(ctx, 18);
+  RedisModule_ReplyWithArray(ctx, 48);
 
   RedisModule_ReplyWithSimpleString(ctx, "KEY");
   RedisModule_ReplyWithString(ctx, rstats->key);
@@ -809,12 +1036,56 @@ int RedisAI_Info_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
   RedisModule_ReplyWithLongLong(ctx, rstats->calls);
   RedisModule_ReplyWithSimpleString(ctx, "ERRORS");
   RedisModule_ReplyWithLongLong(ctx, rstats->nerrors);
+  RedisModule_ReplyWithSimpleString(ctx, "REJECTED");
+  RedisModule_ReplyWithLongLong(ctx, rstats->nrejected);
+  RedisModule_ReplyWithSimpleString(ctx, "BATCHCURVE");
+  if (model) {
+    RAI_ModelReplyWithLatencyCurve(ctx, model);
+  }
+  else {
+    RedisModule_ReplyWithArray(ctx, 0);
+  }
+  RedisModule_ReplyWithSimpleString(ctx, "TARGETBATCHSIZE");
+  if (model && model->opts.targetlatency > 0) {
+    RedisModule_ReplyWithLongLong(ctx, model->latency.target_batchsize);
+  }
+  else {
+    RedisModule_ReplyWithLongLong(ctx, -1);
+  }
+  RAI_ModelCache *cache = model ? model->cache : NULL;
+  RedisModule_ReplyWithSimpleString(ctx, "CACHEHITS");
+  RedisModule_ReplyWithLongLong(ctx, cache ? cache->hits : -1);
+  RedisModule_ReplyWithSimpleString(ctx, "CACHEMISSES");
+  RedisModule_ReplyWithLongLong(ctx, cache ? cache->misses : -1);
+  RedisModule_ReplyWithSimpleString(ctx, "CACHEEVICTIONS");
+  RedisModule_ReplyWithLongLong(ctx, cache ? cache->evictions : -1);
+  RedisModule_ReplyWithSimpleString(ctx, "QUEUEWAIT");
+  RedisModule_ReplyWithLongLong(ctx, rstats->queue_wait_us);
+  RedisModule_ReplyWithSimpleString(ctx, "TENANT");
+  RedisModule_ReplyWithSimpleString(ctx, tenant_name);
+  RedisModule_ReplyWithSimpleString(ctx, "WEIGHT");
+  RedisModule_ReplyWithLongLong(ctx, runQueueTenantWeight(tenant_name));
+  RedisModule_ReplyWithSimpleString(ctx, "TENANTCALLS");
+  RedisModule_ReplyWithLongLong(ctx, tenant ? atomic_load(&tenant->nruns) : 0);
+  RedisModule_ReplyWithSimpleString(ctx, "TENANTDURATION");
+  RedisModule_ReplyWithLongLong(ctx, tenant ? atomic_load(&tenant->run_us) : 0);
+  RedisModule_ReplyWithSimpleString(ctx, "TENANTQUEUEWAIT");
+  RedisModule_ReplyWithLongLong(ctx, tenant ? atomic_load(&tenant->wait_us) : 0);
+  RedisModule_ReplyWithSimpleString(ctx, "TENANTMAXQUEUEWAIT");
+  RedisModule_ReplyWithLongLong(ctx, tenant ? atomic_load(&tenant->max_wait_us) : 0);
+  RedisModule_ReplyWithSimpleString(ctx, "TENANTDEFICIT");
+  RedisModule_ReplyWithLongLong(ctx, tenant ? atomic_load(&tenant->deficit_us) : 0);
+  RedisModule_ReplyWithSimpleString(ctx, "FALLBACKCOPIES");
+  RedisModule_ReplyWithLongLong(ctx, model ? atomic_load(&model->fallback_copies) : -1);
 
   return REDISMODULE_OK;
 }
 
 /** 
-* AI.CONFIG [BACKENDSPATH <default_location_of_backend_libraries> | LOADBACKEND <backend_identifier> <location_of_backend_library>]
+* AI.CONFIG [BACKENDSPATH <default_location_of_backend_libraries> | LOADBACKEND <backend_identifier> <location_of_backend_library>
+*            | THREADS_PER_QUEUE [<device>] <n> | CPU_AFFINITY <device> <cpulist>
+*            | CORE_BUDGET <n> | MAX_QUEUE_LENGTH <n> | MAX_QUEUE_WAIT <ms>
+*            | WORK_STEALING [<device>] <n> | WEIGHT <tenant> <w>]
 */
 int RedisAI_Config_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   if (argc < 2) return RedisModule_WrongArity(ctx);
@@ -824,6 +1095,117 @@ int RedisAI_Config_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, i
     return RedisAI_Config_LoadBackend(ctx, argv + 1, argc - 1);
   }
 
+  if (!strcasecmp(subcommand, "THREADS_PER_QUEUE")) {
+    if (argc == 3) {
+      // default for the devices whose queue doesn't exist yet
+      if (RedisAI_Config_QueueThreads(argv[2]) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR error setting THREADS_PER_QUEUE");
+      }
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    if (argc == 4) {
+      const char *devicestr = RedisModule_StringPtrLen(argv[2], NULL);
+      long long nworkers;
+      if (RedisModule_StringToLongLong(argv[3], &nworkers) != REDISMODULE_OK ||
+          nworkers < 1) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR error setting THREADS_PER_QUEUE");
+      }
+      RunQueueInfo *run_queue_info = NULL;
+      if (ensureRunQueue(devicestr, &run_queue_info) == REDISMODULE_ERR) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR Queue not initialized for device");
+      }
+      if (resizeRunQueue(run_queue_info, nworkers) == REDISMODULE_ERR) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR Could not start the worker threads for device");
+      }
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    return RedisModule_WrongArity(ctx);
+  }
+
+  if (!strcasecmp(subcommand, "CPU_AFFINITY")) {
+    if (argc != 4) return RedisModule_WrongArity(ctx);
+    const char *devicestr = RedisModule_StringPtrLen(argv[2], NULL);
+    const char *cpulist = RedisModule_StringPtrLen(argv[3], NULL);
+    RunQueueInfo *run_queue_info = NULL;
+    if (ensureRunQueue(devicestr, &run_queue_info) == REDISMODULE_ERR) {
+      return RedisModule_ReplyWithError(
+          ctx, "ERR Queue not initialized for device");
+    }
+    if (setRunQueueAffinity(run_queue_info, cpulist) == REDISMODULE_ERR) {
+      return RedisModule_ReplyWithError(ctx, "ERR error setting CPU_AFFINITY");
+    }
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+  }
+
+  if (!strcasecmp(subcommand, "CORE_BUDGET")) {
+    if (argc > 2 && RedisAI_Config_CoreBudget(argv[2]) == REDISMODULE_OK) {
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    return RedisModule_ReplyWithError(ctx, REDISAI_ERRORMSG_CORE_BUDGET);
+  }
+
+  if (!strcasecmp(subcommand, "MAX_QUEUE_LENGTH")) {
+    if (argc > 2 && RedisAI_Config_QueueMaxLength(argv[2]) == REDISMODULE_OK) {
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    return RedisModule_ReplyWithError(ctx, REDISAI_ERRORMSG_MAX_QUEUE_LENGTH);
+  }
+
+  if (!strcasecmp(subcommand, "MAX_QUEUE_WAIT")) {
+    if (argc > 2 && RedisAI_Config_QueueMaxWait(argv[2]) == REDISMODULE_OK) {
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    return RedisModule_ReplyWithError(ctx, REDISAI_ERRORMSG_MAX_QUEUE_WAIT);
+  }
+
+  if (!strcasecmp(subcommand, "WORK_STEALING")) {
+    if (argc == 3) {
+      // default for the devices whose queue doesn't exist yet, and all the
+      // existing ones
+      if (RedisAI_Config_WorkStealing(argv[2]) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, REDISAI_ERRORMSG_WORK_STEALING);
+      }
+      setRunQueuesWorkStealing(getRunQueueStealThreshold());
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    if (argc == 4) {
+      const char *devicestr = RedisModule_StringPtrLen(argv[2], NULL);
+      long long min_pending;
+      if (RedisModule_StringToLongLong(argv[3], &min_pending) != REDISMODULE_OK ||
+          min_pending < 0) {
+        return RedisModule_ReplyWithError(ctx, REDISAI_ERRORMSG_WORK_STEALING);
+      }
+      RunQueueInfo *run_queue_info = NULL;
+      if (ensureRunQueue(devicestr, &run_queue_info) == REDISMODULE_ERR) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR Queue not initialized for device");
+      }
+      if (setRunQueueWorkStealing(run_queue_info, min_pending) ==
+          REDISMODULE_ERR) {
+        return RedisModule_ReplyWithError(
+            ctx, "ERR WORK_STEALING is only supported on CPU devices");
+      }
+      return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    }
+    return RedisModule_WrongArity(ctx);
+  }
+
+  if (!strcasecmp(subcommand, "WEIGHT")) {
+    if (argc != 4) return RedisModule_WrongArity(ctx);
+    const char *tenant = RedisModule_StringPtrLen(argv[2], NULL);
+    long long weight;
+    if (RedisModule_StringToLongLong(argv[3], &weight) != REDISMODULE_OK ||
+        weight < 0 || weight > REDISAI_MAX_WEIGHT) {
+      return RedisModule_ReplyWithError(ctx, "ERR error setting WEIGHT");
+    }
+    setRunQueuesTenantWeight(tenant, weight);
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+  }
+
   if (!strcasecmp(subcommand, "BACKENDSPATH")) {
     if (argc > 2) {
       return RedisAI_Config_BackendsPath(
@@ -838,8 +1220,8 @@ int RedisAI_Config_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, i
 }
 
 /**
- * AI.DAGRUN [LOAD <nkeys> key1 key2... ] [PERSIST <nkeys> key1 key2... ] |>
- * [COMMAND1] |> [COMMAND2] |> [COMMANDN]
+ * AI.DAGRUN [LOAD <nkeys> key1 key2... ] [PERSIST <nkeys> key1 key2... ]
+ * [PRIORITY p] [TIMEOUT t] |> [COMMAND1] |> [COMMAND2] |> [COMMANDN]
  *
  * The request is queued and evaded asynchronously from a separate thread. The
  * client blocks until the computation finishes.
@@ -885,6 +1267,15 @@ int RedisAI_DagRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         RAI_FreeRunInfo(ctx, rinfo);
         return REDISMODULE_ERR;
       }
+    } else if (chainingOpCount == 0 && (!strcasecmp(arg_string, "PRIORITY") ||
+                                        !strcasecmp(arg_string, "TIMEOUT"))) {
+      ArgsCursor ac;
+      ArgsCursor_InitRString(&ac, &argv[argpos], argc - argpos);
+      if (RedisAI_ParseRunQueueArgs(ctx, &ac, rinfo) == REDISMODULE_ERR) {
+        RAI_FreeRunInfo(ctx, rinfo);
+        return REDISMODULE_ERR;
+      }
+      argpos += ac.offset - 1;
     } else if (!strcasecmp(arg_string, "|>")) {
       // on the first pipe operator, if LOAD or PERSIST were used, we've already
       // allocated memory
@@ -946,13 +1337,22 @@ int RedisAI_DagRun_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         ctx, "ERR Queue not initialized for device");
   }
 
+  if (runQueueAdmit(run_queue_info, rinfo->err) == REDISMODULE_ERR) {
+    for (size_t i = 0; i < array_len(rinfo->dagOps); i++) {
+      if (rinfo->dagOps[i]->commandType == REDISAI_DAG_CMD_MODELRUN) {
+        RAI_AddRejectedRun(rinfo->dagOps[i]->runkey);
+      }
+    }
+    const int ret = RedisModule_ReplyWithError(ctx, rinfo->err->detail_oneline);
+    RAI_FreeRunInfo(ctx,rinfo);
+    return ret;
+  }
+
   rinfo->client = RedisModule_BlockClient(ctx, RedisAI_DagRun_Reply, NULL,
-                                          NULL, 0);
+                                          RedisAI_FreeData, 0);
+  RedisModule_SetDisconnectCallback(rinfo->client, RedisAI_Disconnected);
 
-  pthread_mutex_lock(&run_queue_info->run_queue_mutex);
-  queuePush(run_queue_info->run_queue, rinfo);
-  pthread_cond_signal(&run_queue_info->queue_condition_var);
-  pthread_mutex_unlock(&run_queue_info->run_queue_mutex);
+  runQueuePush(run_queue_info, rinfo);
 
   return REDISMODULE_OK;
 }
@@ -1111,6 +1511,10 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc)
   perqueueThreadPoolSize = REDISAI_DEFAULT_THREADS_PER_QUEUE;
   setBackendsInterOpParallelism(REDISAI_DEFAULT_INTER_OP_PARALLELISM);
   setBackendsIntraOpParallelism(REDISAI_DEFAULT_INTRA_OP_PARALLELISM);
+  setCoreBudget(REDISAI_DEFAULT_CORE_BUDGET);
+  setRunQueueMaxLength(REDISAI_DEFAULT_MAX_QUEUE_LENGTH);
+  setRunQueueMaxWait(REDISAI_DEFAULT_MAX_QUEUE_WAIT);
+  setRunQueueStealThreshold(REDISAI_DEFAULT_WORK_STEALING);
   
   RAI_loadTimeConfig(ctx,argv,argc);
 
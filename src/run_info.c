@@ -67,6 +67,20 @@ int RAI_InitRunInfo(RedisAI_RunInfo **result) {
     return REDISMODULE_ERR;
   }
   rinfo->use_local_context = 0;
+  rinfo->queue_seq = 0;
+  rinfo->tenant = NULL;
+  rinfo->queue_wait_us = 0;
+  rinfo->enqueue_us = 0;
+  rinfo->priority = 0;
+  rinfo->deadline_us = 0;
+  atomic_init(&rinfo->cancelled, 0);
+  rinfo->cache_hash = 0;
+  rinfo->parent = NULL;
+  rinfo->chunks = NULL;
+  atomic_init(&rinfo->pending_chunks, 0);
+  rinfo->chunk_offset = 0;
+  rinfo->chunk_len = 0;
+  rinfo->followers = NULL;
   rinfo->dagTensorsContext = AI_dictCreate(&AI_dictTypeHeapStrings, NULL);
   if (!(rinfo->dagTensorsContext)) {
     return REDISMODULE_ERR;
@@ -112,6 +126,15 @@ void RAI_FreeDagOp(RedisModuleCtx *ctx, RAI_DagOp *dagOp) {
 }
 
 void RAI_FreeRunInfo(RedisModuleCtx *ctx, struct RedisAI_RunInfo *rinfo) {
+  if (rinfo->chunks) {
+    for (size_t i = 0; i < array_len(rinfo->chunks); i++) {
+      RAI_FreeRunInfo(ctx, rinfo->chunks[i]);
+    }
+    array_free(rinfo->chunks);
+  }
+  if (rinfo->followers) {
+    array_free(rinfo->followers);
+  }
   if (rinfo->mctx) {
     RAI_ModelRunCtxFree(rinfo->mctx);
   }
@@ -207,6 +230,53 @@ size_t RAI_RunInfoBatchSize(struct RedisAI_RunInfo *rinfo) {
   return batchsize;
 }
 
+int RAI_RunInfoSplit(struct RedisAI_RunInfo *rinfo, size_t chunk_size) {
+  const long long batchsize = RAI_RunInfoBatchSize(rinfo);
+  const long long nchunks = (batchsize + chunk_size - 1) / chunk_size;
+
+  rinfo->chunks = array_new(struct RedisAI_RunInfo *, nchunks);
+  for (long long i = 0; i < nchunks; i++) {
+    struct RedisAI_RunInfo *chunk;
+    if (RAI_InitRunInfo(&chunk) == REDISMODULE_ERR) {
+      return REDISMODULE_ERR;
+    }
+    chunk->mctx = RAI_ModelRunCtxCreate(rinfo->mctx->model);
+    for (size_t o = 0; o < RAI_ModelRunCtxNumOutputs(rinfo->mctx); o++) {
+      RAI_ModelRunCtxAddOutput(chunk->mctx, rinfo->mctx->outputs[o].name);
+    }
+    chunk->parent = rinfo;
+    chunk->chunk_offset = i * chunk_size;
+    chunk->chunk_len = batchsize - chunk->chunk_offset < (long long)chunk_size
+                           ? batchsize - chunk->chunk_offset
+                           : (long long)chunk_size;
+    chunk->priority = rinfo->priority;
+    chunk->deadline_us = rinfo->deadline_us;
+    chunk->enqueue_us = rinfo->enqueue_us;
+    chunk->tenant = rinfo->tenant;
+    rinfo->chunks = array_append(rinfo->chunks, chunk);
+  }
+  atomic_store(&rinfo->pending_chunks, nchunks);
+  return REDISMODULE_OK;
+}
+
+void RAI_RunInfoSliceChunk(struct RedisAI_RunInfo *chunk) {
+  RAI_ModelRunCtx *mctx = chunk->parent->mctx;
+  for (size_t i = 0; i < RAI_ModelRunCtxNumInputs(mctx); i++) {
+    RAI_Tensor *slice = RAI_TensorCreateBySlicingTensor(
+        RAI_ModelRunCtxInputTensor(mctx, i), chunk->chunk_offset,
+        chunk->chunk_len);
+    RAI_ModelRunCtxAddInput(chunk->mctx, mctx->inputs[i].name, slice);
+    RAI_TensorFree(slice);
+  }
+}
+
+int RAI_RunInfoCancelled(struct RedisAI_RunInfo *rinfo) {
+  if (rinfo->parent) {
+    rinfo = rinfo->parent;
+  }
+  return atomic_load_explicit(&rinfo->cancelled, memory_order_relaxed);
+}
+
 int RAI_RunInfoBatchable(struct RedisAI_RunInfo *rinfo1,
                          struct RedisAI_RunInfo *rinfo2) {
 
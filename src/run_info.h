@@ -3,6 +3,8 @@
 #ifndef SRC_RUN_INFO_H_
 #define SRC_RUN_INFO_H_
 
+#include <stdatomic.h>
+
 #include "err.h"
 #include "model.h"
 #include "model_struct.h"
@@ -73,6 +75,25 @@ typedef struct RedisAI_RunInfo {
   RAI_DagOp **dagOps;
   int dagReplyLength;
   int dagNumberCommands;
+  // Scheduling
+  unsigned long long queue_seq;  // order of arrival in the device run queue
+  long long enqueue_us;          // time of arrival in the device run queue
+  long long priority;            // PRIORITY, higher runs first
+  long long deadline_us;         // TIMEOUT as an absolute time, 0 if none
+  atomic_int cancelled;          // set when the client disconnects
+  uint64_t cache_hash;           // hash of the inputs, if the model caches
+                                 // its results
+  struct RunTenant *tenant;      // share of the run queue it runs on
+  long long queue_wait_us;       // time spent in the run queue
+  // Requests larger than the model's batchsize are run in chunks
+  struct RedisAI_RunInfo *parent;   // request this is a chunk of, or NULL
+  struct RedisAI_RunInfo **chunks;  // chunks of this request, NULL if whole
+  atomic_int pending_chunks;        // chunks not done yet
+  long long chunk_offset;           // first sample of the parent in the chunk
+  long long chunk_len;              // number of samples in the chunk
+  // Identical requests in flight are run once, see runQueuePush
+  struct RedisAI_RunInfo **followers;  // requests sharing the outcome of this
+                                       // one, main thread only
 } RedisAI_RunInfo;
 
 /**
@@ -97,6 +118,35 @@ void RAI_FreeRunInfo(RedisModuleCtx *ctx, RedisAI_RunInfo *rinfo);
  */
 size_t RAI_RunInfoBatchSize(struct RedisAI_RunInfo *rinfo);
 
+/**
+ * Splits a MODELRUN into chunks of at most `chunk_size` samples along the
+ * batch dimension, stored in rinfo->chunks. The chunks carry the scheduling
+ * attributes of the request and the names of its inputs and outputs; their
+ * inputs are only sliced when they run (see RAI_RunInfoSliceChunk). Chunks
+ * are freed along with the request. Main thread only.
+ *
+ * @param rinfo context of the MODELRUN, its batch size larger than chunk_size
+ * @param chunk_size maximum number of samples per chunk
+ * @return REDISMODULE_OK on success, or REDISMODULE_ERR if the allocation
+ * failed.
+ */
+int RAI_RunInfoSplit(struct RedisAI_RunInfo *rinfo, size_t chunk_size);
+
+/**
+ * Sets the inputs of a chunk to its slice of the inputs of the request it
+ * is a chunk of.
+ *
+ * @param chunk one of the chunks created by RAI_RunInfoSplit
+ */
+void RAI_RunInfoSliceChunk(struct RedisAI_RunInfo *chunk);
+
+/**
+ * @param rinfo context in which RedisAI blocking command operate.
+ * @return 1 if the client of the request, or of the request it is a chunk
+ * of, disconnected
+ */
+int RAI_RunInfoCancelled(struct RedisAI_RunInfo *rinfo);
+
 /**
  *
  * @param rinfo1 rinfo context 1 in which RedisAI blocking command 1 operates.
@@ -2,6 +2,7 @@
 #include "script_struct.h"
 #include "backends.h"
 #include "stats.h"
+#include "background_workers.h"
 
 #include "rmutil/alloc.h"
 #include "util/arr_rm_alloc.h"
@@ -23,6 +24,15 @@ static void* RAI_Script_RdbLoad(struct RedisModuleIO *io, int encver) {
   size_t len;
   char *scriptdef = RedisModule_LoadStringBuffer(io, &len);
 
+  long long weight = 1;
+  if (encver >= 1) {
+    weight = RedisModule_LoadSigned(io);
+    if (weight <= 0 || weight > REDISAI_MAX_WEIGHT) {
+      RedisModule_LogIOError(io, "warning", "Invalid WEIGHT %lld, using 1", weight);
+      weight = 1;
+    }
+  }
+
   RAI_Script *script = RAI_ScriptCreate(devicestr, tag, scriptdef, &err);
 
   if (err.code == RAI_EBACKENDNOTLOADED) {
@@ -44,6 +54,10 @@ static void* RAI_Script_RdbLoad(struct RedisModuleIO *io, int encver) {
     RAI_ClearError(&err);
   }
 
+  if (script) {
+    script->weight = weight;
+  }
+
   RedisModuleCtx* stats_ctx = RedisModule_GetContextFromIO(io);
   RedisModuleString* stats_keystr = RedisModule_CreateStringFromString(stats_ctx,
                                                                        RedisModule_GetKeyNameFromIO(io));
@@ -51,6 +65,7 @@ static void* RAI_Script_RdbLoad(struct RedisModuleIO *io, int encver) {
   const char* stats_tag = RedisModule_Strdup(tag);
 
   script->infokey = RAI_AddStatsEntry(stats_ctx, stats_keystr, RAI_SCRIPT, RAI_BACKEND_TORCH, stats_devicestr, stats_tag);
+  runQueuesAddTenantKey(script->tag, script->infokey, script->weight);
 
   RedisModule_Free(stats_keystr);
 
@@ -65,15 +80,20 @@ static void RAI_Script_RdbSave(RedisModuleIO *io, void *value) {
   RedisModule_SaveStringBuffer(io, script->devicestr, strlen(script->devicestr) + 1);
   RedisModule_SaveStringBuffer(io, script->tag, strlen(script->tag) + 1);
   RedisModule_SaveStringBuffer(io, script->scriptdef, len);
+  RedisModule_SaveSigned(io, script->weight);
 }
 
 static void RAI_Script_AofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
   RAI_Script *script = (RAI_Script*)value;
 
-  RedisModule_EmitAOF(aof, "AI.SCRIPTSET", "sccc", key, script->devicestr, script->tag, script->scriptdef);
+  RedisModule_EmitAOF(aof, "AI.SCRIPTSET", "scccclc", key, script->devicestr,
+                      "TAG", script->tag, "WEIGHT", script->weight,
+                      script->scriptdef);
 }
 
 static void RAI_Script_DTFree(void *value) {
+  RAI_Script *script = value;
+  runQueuesRemoveTenantKey(script->tag, script->infokey, script->weight);
   RAI_Error err = {0};
   RAI_ScriptFree(value, &err);
   if (err.code != RAI_OK) {
@@ -93,7 +113,7 @@ int RAI_ScriptInit(RedisModuleCtx* ctx) {
       .digest = NULL
   };
 
-  RedisAI_ScriptType = RedisModule_CreateDataType(ctx, "AI_SCRIPT", 0, &tmScript);
+  RedisAI_ScriptType = RedisModule_CreateDataType(ctx, "AI_SCRIPT", RAI_SCRIPT_ENC_VER, &tmScript);
   return RedisAI_ScriptType != NULL;
 }
 
@@ -106,6 +126,7 @@ RAI_Script *RAI_ScriptCreate( const char* devicestr, const char* tag, const char
 
   if (script) {
     script->tag = RedisModule_Strdup(tag);
+    script->weight = 1;
   }
 
   return script;
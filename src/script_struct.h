@@ -13,6 +13,7 @@ typedef struct RAI_Script {
   // CUDA allocator for dlpack
   char* devicestr;
   char* tag;
+  long long weight;  // share of the device run time, see RAI_ModelOpts
   long long refCount;
   void* infokey;
 } RAI_Script;
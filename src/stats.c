@@ -33,6 +33,15 @@ void* RAI_AddStatsEntry(RedisModuleCtx* ctx, RedisModuleString* key,
   return (void*)infokey;
 }
 
+void RAI_AddRejectedRun(RedisModuleString* key) {
+  const char* infokey = RedisModule_StringPtrLen(key, NULL);
+  AI_dictEntry* stats_entry = AI_dictFind(run_stats, infokey);
+  if (stats_entry) {
+    struct RedisAI_RunStats* rstats = AI_dictGetVal(stats_entry);
+    rstats->nrejected += 1;
+  }
+}
+
 void RAI_ListStatsEntries(RAI_RunType type, long long* nkeys,
                           RedisModuleString*** keys, const char*** tags) {
   AI_dictIterator* stats_iter = AI_dictGetSafeIterator(run_stats);
@@ -14,9 +14,11 @@ struct RedisAI_RunStats {
   char* devicestr;
   char* tag;
   long long duration_us;
+  long long queue_wait_us;
   long long samples;
   long long calls;
   long long nerrors;
+  long long nrejected;
 };
 
 AI_dict* run_stats;
@@ -30,6 +32,14 @@ void* RAI_AddStatsEntry(RedisModuleCtx* ctx, RedisModuleString* key,
 
 void RAI_RemoveStatsEntry(void* infokey);
 
+/**
+ * Counts a run of the given key that was turned away by the run queue
+ * admission control.
+ *
+ * @param key model or script key
+ */
+void RAI_AddRejectedRun(RedisModuleString* key);
+
 void RAI_ListStatsEntries(RAI_RunType type, long long* nkeys,
                           RedisModuleString*** keys, const char*** tags);
 
@@ -6,7 +6,9 @@
 #include <string.h>
 #include "rmutil/alloc.h"
 #include "util/dict.h"
+#include "util/pool.h"
 #include <assert.h>
+#include <pthread.h>
 #include "redisai.h"
 
 RedisModuleType *RedisAI_TensorType = NULL;
@@ -127,10 +129,10 @@ static void* RAI_Tensor_RdbLoad(struct RedisModuleIO *io, int encver) {
 
   size_t ndims = RedisModule_LoadUnsigned(io);
 
-  RAI_Tensor *ret = RedisModule_Calloc(1, sizeof(*ret));
+  RAI_Tensor *ret = RAI_TensorNew(ndims);
 
-  int64_t* shape = RedisModule_Calloc(ndims, sizeof(*shape));
-  int64_t* strides = RedisModule_Calloc(ndims, sizeof(*strides));
+  int64_t* shape = ret->tensor.dl_tensor.shape;
+  int64_t* strides = ret->tensor.dl_tensor.strides;
   for (size_t i = 0 ; i < ndims ; ++i){
     shape[i] = RedisModule_LoadUnsigned(io);
   }
@@ -142,23 +144,16 @@ static void* RAI_Tensor_RdbLoad(struct RedisModuleIO *io, int encver) {
   size_t byte_offset = RedisModule_LoadUnsigned(io);
   
   size_t len;
-  char *data = RedisModule_LoadStringBuffer(io, &len);
-
-  ret->tensor = (DLManagedTensor){
-    .dl_tensor = (DLTensor){
-      .ctx = ctx,
-      .data = data,
-      .ndim = ndims,
-      .dtype = dtype,
-      .shape = shape,
-      .strides = strides,
-      .byte_offset = 0
-    },
-    .manager_ctx = NULL,
-    .deleter = NULL
-  };
-
-  ret->refCount = 1;
+  char *buffer = RedisModule_LoadStringBuffer(io, &len);
+  // tensor data comes from the tensor pool, so that RAI_TensorFree can tell
+  // its size class
+  char *data = RAI_TensorNewData(len, 0);
+  memcpy(data, buffer, len);
+  RedisModule_Free(buffer);
+
+  ret->tensor.dl_tensor.ctx = ctx;
+  ret->tensor.dl_tensor.data = data;
+  ret->tensor.dl_tensor.dtype = dtype;
   return ret;
 }
 
@@ -222,7 +217,16 @@ static void RAI_Tensor_DTFree(void *value) {
   RAI_TensorFree(value);
 }
 
+// the thread Redis runs commands on, which may release strings without
+// taking the GIL
+static pthread_t tensor_main_thread;
+
+// RedisModule_TrimStringAllocation, NULL if the server does not export it
+static void (*tensor_trim_string)(RedisModuleString*) = NULL;
+
 int RAI_TensorInit(RedisModuleCtx* ctx){
+  tensor_main_thread = pthread_self();
+  RedisModule_GetApi("RedisModule_TrimStringAllocation", (void**)&tensor_trim_string);
   RedisModuleTypeMethods tmTensor = {
       .version = REDISMODULE_TYPE_METHOD_VERSION,
       .rdb_load = RAI_Tensor_RdbLoad,
@@ -236,15 +240,63 @@ int RAI_TensorInit(RedisModuleCtx* ctx){
   return RedisAI_TensorType != NULL;
 }
 
+RAI_Tensor* RAI_TensorNew(int ndims) {
+  RAI_Tensor* ret = poolAlloc(sizeof(*ret) + 2 * ndims * sizeof(int64_t));
+  if (ret == NULL) {
+    return NULL;
+  }
+
+  int64_t* shape = (int64_t*)(ret + 1);
+  ret->tensor = (DLManagedTensor){
+    .dl_tensor = (DLTensor){
+      .data = NULL,
+      .ndim = ndims,
+      .shape = shape,
+      .strides = shape + ndims,
+      .byte_offset = 0
+    },
+    .manager_ctx = NULL,
+    .deleter = NULL
+  };
+
+  ret->refCount = 1;
+  return ret;
+}
+
+void* RAI_TensorNewData(size_t nbytes, int zero) {
+  // the pool only aligns like malloc: allocate enough to align the data, and
+  // keep the block right before it for RAI_TensorFreeData
+  char* block = poolAlloc(nbytes + sizeof(void*) + RAI_TENSOR_DATA_ALIGNMENT - 1);
+  if (block == NULL) {
+    return NULL;
+  }
+  const uintptr_t mask = RAI_TENSOR_DATA_ALIGNMENT - 1;
+  void** data = (void**)(((uintptr_t)(block + sizeof(void*)) + mask) & ~mask);
+  data[-1] = block;
+  if (zero) {
+    memset(data, 0, nbytes);
+  }
+  return data;
+}
+
+static void RAI_TensorFreeData(void* data) {
+  if (data) {
+    poolFree(((void**)data)[-1]);
+  }
+}
+
 RAI_Tensor* RAI_TensorCreateWithDLDataType(DLDataType dtype, long long* dims, int ndims, int tensorAllocMode) {
   const size_t dtypeSize = Tensor_DataTypeSize(dtype);
   if ( dtypeSize == 0){
     return NULL;
   }
 
-  RAI_Tensor* ret = RedisModule_Alloc(sizeof(*ret));
-  int64_t* shape = RedisModule_Alloc(ndims*sizeof(*shape));
-  int64_t* strides = RedisModule_Alloc(ndims*sizeof(*strides));
+  RAI_Tensor* ret = RAI_TensorNew(ndims);
+  if (ret == NULL) {
+    return NULL;
+  }
+  int64_t* shape = ret->tensor.dl_tensor.shape;
+  int64_t* strides = ret->tensor.dl_tensor.strides;
 
   size_t len = 1;
   for (int64_t i = 0 ; i < ndims ; ++i){
@@ -264,10 +316,10 @@ RAI_Tensor* RAI_TensorCreateWithDLDataType(DLDataType dtype, long long* dims, in
   switch (tensorAllocMode)
   {
   case TENSORALLOC_ALLOC:
-    data = RedisModule_Alloc(len * dtypeSize);
+    data = RAI_TensorNewData(len * dtypeSize, 0);
     break;
   case TENSORALLOC_CALLOC:
-    data = RedisModule_Calloc(len, dtypeSize);
+    data = RAI_TensorNewData(len * dtypeSize, 1);
     break;
   case TENSORALLOC_NONE:
     /* shallow copy no alloc */
@@ -278,25 +330,67 @@ RAI_Tensor* RAI_TensorCreateWithDLDataType(DLDataType dtype, long long* dims, in
   }
 
   if (tensorAllocMode != TENSORALLOC_NONE && data == NULL){
-    RedisModule_Free(ret);
+    poolFree(ret);
     return NULL;
   }
 
-  ret->tensor = (DLManagedTensor){
-    .dl_tensor = (DLTensor){
-      .ctx = ctx,
-      .data = data,
-      .ndim = ndims,
-      .dtype = dtype,
-      .shape = shape,
-      .strides = strides,
-      .byte_offset = 0
-    },
-    .manager_ctx = NULL,
-    .deleter = NULL
-  };
+  ret->tensor.dl_tensor.ctx = ctx;
+  ret->tensor.dl_tensor.data = data;
+  ret->tensor.dl_tensor.dtype = dtype;
+  return ret;
+}
 
-  ret->refCount = 1;
+static void RAI_TensorStringDeleter(DLManagedTensor* self) {
+  // the last reference may be dropped by a worker, which must hold the GIL
+  // to release a string
+  if (pthread_equal(pthread_self(), tensor_main_thread)) {
+    RedisModule_FreeString(NULL, self->manager_ctx);
+  } else {
+    RedisModuleCtx* ctx = RedisModule_GetThreadSafeContext(NULL);
+    RedisModule_ThreadSafeContextLock(ctx);
+    RedisModule_FreeString(NULL, self->manager_ctx);
+    RedisModule_ThreadSafeContextUnlock(ctx);
+    RedisModule_FreeThreadSafeContext(ctx);
+  }
+  // self is the first member of its RAI_Tensor, which holds shape and strides
+  poolFree(self);
+}
+
+RAI_Tensor* RAI_TensorCreateFromString(DLDataType dtype, long long* dims, int ndims, RedisModuleString* blob) {
+  const size_t dtypeSize = Tensor_DataTypeSize(dtype);
+  if (dtypeSize == 0) {
+    return NULL;
+  }
+
+  // Redis trims the spare capacity of the arguments a command retained once
+  // it returns, which may move their buffer. A long argument is built on the
+  // over-allocated query buffer, so only a string trimmed beforehand keeps
+  // its buffer, and no more memory than its length; without the API to do
+  // so, the blob is copied.
+  if (tensor_trim_string == NULL) {
+    return NULL;
+  }
+  tensor_trim_string(blob);
+
+  // the buffer of a long string is preceded by a header of an odd number of
+  // bytes, so wider types are most often misaligned and copied. A string
+  // taken over is the only tensor data not aligned to
+  // RAI_TENSOR_DATA_ALIGNMENT, backends that need it count a fallback copy.
+  size_t datalen;
+  const char* data = RedisModule_StringPtrLen(blob, &datalen);
+  if ((uintptr_t)data % dtypeSize != 0) {
+    return NULL;
+  }
+
+  RAI_Tensor* ret = RAI_TensorCreateWithDLDataType(dtype, dims, ndims, TENSORALLOC_NONE);
+  if (ret == NULL) {
+    return NULL;
+  }
+
+  RedisModule_RetainString(NULL, blob);
+  ret->tensor.dl_tensor.data = (void*)data;
+  ret->tensor.manager_ctx = blob;
+  ret->tensor.deleter = RAI_TensorStringDeleter;
   return ret;
 }
 
@@ -322,12 +416,40 @@ void RAI_TensorMoveFrom(RAI_Tensor* dst, RAI_Tensor* src) {
 }
 #endif
 
+static void RAI_TensorViewDeleter(DLManagedTensor* self) {
+  RAI_TensorFree(self->manager_ctx);
+  // self is the first member of its RAI_Tensor, which holds shape and strides
+  poolFree(self);
+}
+
+static int RAI_TensorIsView(RAI_Tensor* t) {
+  return t->tensor.deleter == RAI_TensorViewDeleter;
+}
+
+// a view of a view refers to the same parent, instead of chaining
+static RAI_Tensor* RAI_TensorViewParent(RAI_Tensor* t) {
+  return RAI_TensorIsView(t) ? t->tensor.manager_ctx : t;
+}
+
+static RAI_Tensor* RAI_TensorCreateView(RAI_Tensor* t, char* data, long long* dims, int ndims) {
+  RAI_Tensor* ret = RAI_TensorCreateWithDLDataType(RAI_TensorDataType(t), dims, ndims, TENSORALLOC_NONE);
+  ret->tensor.dl_tensor.data = data;
+  ret->tensor.manager_ctx = RAI_TensorGetShallowCopy(RAI_TensorViewParent(t));
+  ret->tensor.deleter = RAI_TensorViewDeleter;
+  return ret;
+}
+
 RAI_Tensor* RAI_TensorCreateByConcatenatingTensors(RAI_Tensor** ts, long long n) {
 
   if (n == 0) {
     return NULL;
   }
 
+  // a request alone in its batch runs on its own tensor
+  if (n == 1) {
+    return RAI_TensorGetShallowCopy(ts[0]);
+  }
+
   long long total_batch_size = 0;
   long long batch_sizes[n];
   long long batch_offsets[n];
@@ -357,6 +479,18 @@ RAI_Tensor* RAI_TensorCreateByConcatenatingTensors(RAI_Tensor** ts, long long n)
 
   const long long dtype_size = RAI_TensorDataSize(ts[0]);
 
+  // tensors that already follow each other in the buffer of one parent, like
+  // the outputs of a batch fed to the next model in the same order, are
+  // concatenated by a view spanning them
+  int adjacent = 1;
+  for (long long i=1; i<n && adjacent; i++) {
+    adjacent = RAI_TensorViewParent(ts[i]) == RAI_TensorViewParent(ts[0]) &&
+               RAI_TensorData(ts[i-1]) + RAI_TensorByteSize(ts[i-1]) == RAI_TensorData(ts[i]);
+  }
+  if (adjacent) {
+    return RAI_TensorCreateView(ts[0], RAI_TensorData(ts[0]), dims, ndims);
+  }
+
   DLDataType dtype = RAI_TensorDataType(ts[0]);
 
   RAI_Tensor* ret = RAI_TensorCreateWithDLDataType(dtype, dims, ndims, TENSORALLOC_ALLOC);
@@ -383,11 +517,103 @@ RAI_Tensor* RAI_TensorCreateBySlicingTensor(RAI_Tensor* t, long long offset, lon
 
   dims[0] = len;
 
+  return RAI_TensorCreateView(t, RAI_TensorData(t) + offset * sample_size * dtype_size, dims, ndims);
+}
+
+void RAI_TensorCompactView(RAI_Tensor* t) {
+  // another holder of the view may be reading its data
+  if (!RAI_TensorIsView(t) || t->refCount != 1) {
+    return;
+  }
+
+  // the parent's references are its views, assumed of about the same size
+  RAI_Tensor* parent = t->tensor.manager_ctx;
+  const size_t nbytes = RAI_TensorByteSize(t);
+  if (RAI_TensorByteSize(parent) <= RAI_TENSOR_VIEW_COMPACT_FACTOR * nbytes * parent->refCount) {
+    return;
+  }
+
+  void* data = RAI_TensorNewData(nbytes, 0);
+  memcpy(data, RAI_TensorData(t), nbytes);
+  t->tensor.dl_tensor.data = data;
+  t->tensor.manager_ctx = NULL;
+  t->tensor.deleter = NULL;
+  RAI_TensorFree(parent);
+}
+
+RAI_Tensor* RAI_TensorCreateByPadding(RAI_Tensor* t, long long len, double value) {
+
+  const long long ndims = RAI_TensorNumDims(t);
+  long long dims[ndims];
+
+  const long long dtype_size = RAI_TensorDataSize(t);
+  long long inner_size = 1;
+
+  for (long long i=0; i<ndims; i++) {
+    dims[i] = RAI_TensorDim(t, i);
+    if (i > 1) {
+      inner_size *= dims[i];
+    }
+  }
+
+  const long long row_size = dims[1] * inner_size * dtype_size;
+  const long long padded_row_size = len * inner_size * dtype_size;
+  dims[1] = len;
+
   DLDataType dtype = RAI_TensorDataType(t);
 
   RAI_Tensor* ret = RAI_TensorCreateWithDLDataType(dtype, dims, ndims, TENSORALLOC_ALLOC);
+  if (dims[0] == 0 || padded_row_size == 0) {
+    return ret;
+  }
 
-  memcpy(RAI_TensorData(ret), RAI_TensorData(t) + offset * sample_size * dtype_size, len * sample_size * dtype_size);
+  // encode the padding value once, through the first element of the tensor
+  if (dtype.code == kDLFloat) {
+    RAI_TensorSetValueFromDouble(ret, 0, value);
+  }
+  else {
+    RAI_TensorSetValueFromLongLong(ret, 0, (long long)value);
+  }
+  char pad[dtype_size];
+  memcpy(pad, RAI_TensorData(ret), dtype_size);
+
+  for (long long b=0; b<dims[0]; b++) {
+    char *row = RAI_TensorData(ret) + b * padded_row_size;
+    memcpy(row, RAI_TensorData(t) + b * row_size, row_size);
+    for (long long offset=row_size; offset<padded_row_size; offset+=dtype_size) {
+      memcpy(row + offset, pad, dtype_size);
+    }
+  }
+
+  return ret;
+}
+
+RAI_Tensor* RAI_TensorCreateByNarrowing(RAI_Tensor* t, long long len) {
+
+  const long long ndims = RAI_TensorNumDims(t);
+  long long dims[ndims];
+
+  const long long dtype_size = RAI_TensorDataSize(t);
+  long long inner_size = 1;
+
+  for (long long i=0; i<ndims; i++) {
+    dims[i] = RAI_TensorDim(t, i);
+    if (i > 1) {
+      inner_size *= dims[i];
+    }
+  }
+
+  const long long row_size = dims[1] * inner_size * dtype_size;
+  const long long narrowed_row_size = len * inner_size * dtype_size;
+  dims[1] = len;
+
+  DLDataType dtype = RAI_TensorDataType(t);
+
+  RAI_Tensor* ret = RAI_TensorCreateWithDLDataType(dtype, dims, ndims, TENSORALLOC_ALLOC);
+
+  for (long long b=0; b<dims[0]; b++) {
+    memcpy(RAI_TensorData(ret) + b * narrowed_row_size, RAI_TensorData(t) + b * row_size, narrowed_row_size);
+  }
 
   return ret;
 }
@@ -423,7 +649,7 @@ int RAI_TensorCopyTensor(RAI_Tensor* t, RAI_Tensor** dest) {
 // Beware: this will take ownership of dltensor
 RAI_Tensor* RAI_TensorCreateFromDLTensor(DLManagedTensor* dl_tensor) {
 
-  RAI_Tensor* ret = RedisModule_Calloc(1, sizeof(*ret));
+  RAI_Tensor* ret = poolCalloc(sizeof(*ret));
 
   ret->tensor = (DLManagedTensor){
     .dl_tensor = (DLTensor){
@@ -475,16 +701,9 @@ void RAI_TensorFree(RAI_Tensor *t) {
       if (t->tensor.deleter) {
         t->tensor.deleter(&t->tensor);
       } else {
-        if (t->tensor.dl_tensor.shape) {
-          RedisModule_Free(t->tensor.dl_tensor.shape);
-        }
-        if (t->tensor.dl_tensor.strides) {
-          RedisModule_Free(t->tensor.dl_tensor.strides);
-        }
-        if (t->tensor.dl_tensor.data) {
-          RedisModule_Free(t->tensor.dl_tensor.data);
-        }
-        RedisModule_Free(t);
+        // shape and strides are allocated along with the tensor
+        RAI_TensorFreeData(t->tensor.dl_tensor.data);
+        poolFree(t);
       }
     }
   }
@@ -680,6 +899,7 @@ int RAI_GetTensorFromKeyspace(RedisModuleCtx *ctx, RedisModuleString *keyName,
     return REDISMODULE_ERR;
   }
   *tensor = RedisModule_ModuleTypeGetValue(*key);
+  RAI_TensorCompactView(*tensor);
   return REDISMODULE_OK;
 }
 
@@ -766,7 +986,8 @@ int RAI_parseTensorSetArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     remaining_args = argc - 1 - argpos;
     if (!strcasecmp(opt, "BLOB")) {
       datafmt = REDISAI_DATA_BLOB;
-      tensorAllocMode = TENSORALLOC_CALLOC;
+      // the blob overwrites all of the data, no need to zero it
+      tensorAllocMode = TENSORALLOC_ALLOC;
       // if we've found the dataformat there are no more dimensions
       // check right away if the arity is correct
       if (remaining_args != 1 && enforceArity == 1) {
@@ -824,8 +1045,30 @@ int RAI_parseTensorSetArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
   size_t datalen;
   const char *data;
   DLDataType datatype = RAI_TensorDataTypeFromString(typestr);
-  *t = RAI_TensorCreateWithDLDataType(datatype, dims, ndims, tensorAllocMode);
-  if (!t){
+  *t = NULL;
+  if (datafmt == REDISAI_DATA_BLOB) {
+    RedisModule_StringPtrLen(argv[argpos], &datalen);
+    if (datalen != nbytes) {
+      array_free(dims);
+      if (ctx == NULL) {
+        RAI_SetError(error, RAI_ETENSORSET,
+                      "ERR data length does not match tensor shape and type");
+      } else {
+        RedisModule_ReplyWithError(ctx, "ERR data length does not match tensor shape and type");
+      }
+      return -1;
+    }
+    // AI.TENSORSET takes the blob over instead of copying it. A DAG copies
+    // it, since the DAG's tensors are freed by a worker while the client
+    // may still hold its arguments, and strings are not thread safe.
+    if (ctx != NULL) {
+      *t = RAI_TensorCreateFromString(datatype, dims, ndims, argv[argpos]);
+    }
+  }
+  if (*t == NULL) {
+    *t = RAI_TensorCreateWithDLDataType(datatype, dims, ndims, tensorAllocMode);
+  }
+  if (*t == NULL){
     array_free(dims);
     if (ctx == NULL) {
       RAI_SetError(error, RAI_ETENSORSET,
@@ -841,18 +1084,9 @@ int RAI_parseTensorSetArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
     case REDISAI_DATA_BLOB:
     {
       const char*blob = RedisModule_StringPtrLen(argv[argpos],&datalen);
-      if (datalen != nbytes){
-        RAI_TensorFree(*t);
-        array_free(dims);
-        if (ctx == NULL) {
-          RAI_SetError(error, RAI_ETENSORSET,
-                        "ERR data length does not match tensor shape and type");
-        } else {
-          RedisModule_ReplyWithError(ctx, "ERR data length does not match tensor shape and type");
-        }
-        return -1;
+      if (RAI_TensorData(*t) != blob) {
+        RAI_TensorSetData(*t,blob,datalen);
       }
-      RAI_TensorSetData(*t,blob,datalen);
     }
       break;
     case REDISAI_DATA_VALUES:
@@ -12,6 +12,14 @@
 #define TENSORALLOC_ALLOC 1
 #define TENSORALLOC_CALLOC 2
 
+// A view is compacted once its parent is this many times larger than the
+// data referenced by all of its views
+#define RAI_TENSOR_VIEW_COMPACT_FACTOR 2
+
+// Alignment of the data allocated for tensors, a cache line, which is also
+// enough for the widest SIMD loads
+#define RAI_TENSOR_DATA_ALIGNMENT 64
+
 // Numeric data type of tensor elements, one of FLOAT, DOUBLE, INT8, INT16, INT32, INT64, UINT8, UINT16
 static const char* RAI_DATATYPE_STR_FLOAT = "FLOAT";
 static const char* RAI_DATATYPE_STR_DOUBLE = "DOUBLE";
@@ -26,8 +34,39 @@ extern RedisModuleType *RedisAI_TensorType;
 
 int RAI_TensorInit(RedisModuleCtx* ctx);
 RAI_Tensor* RAI_TensorCreate(const char* dataType, long long* dims, int ndims, int hasdata);
+
+/**
+ * Allocate a Tensor from the tensor pool, with its shape and strides stored
+ * right after it in the same block. The shape, strides and data are left for
+ * the caller to fill in, the other fields are zeroed.
+ * @param ndims Number of dimensions.
+ * @return the tensor, with a refcount of 1
+ */
+RAI_Tensor* RAI_TensorNew(int ndims);
+
+/**
+ * Allocate a buffer for the data of a Tensor from the tensor pool, aligned to
+ * RAI_TENSOR_DATA_ALIGNMENT. Tensors without a deleter release their data
+ * with the pool, so their data must come from here.
+ * @param nbytes Size of the buffer.
+ * @param zero Whether to zero the buffer.
+ * @return the buffer
+ */
+void* RAI_TensorNewData(size_t nbytes, int zero);
 RAI_Tensor* RAI_TensorCreateWithDLDataType(DLDataType dtype, long long* dims, int ndims, int tensorAllocMode);
 
+/**
+ * Allocate a new Tensor whose data is the buffer of a string, without
+ * copying it. The tensor keeps a reference to the string until it is freed.
+ * @param dtype Data type of the tensor elements.
+ * @param dims Shape of the tensor.
+ * @param ndims Number of dimensions.
+ * @param blob String holding the tensor data, of the tensor's byte size.
+ * @return the tensor, or NULL if the string's buffer is not aligned for
+ * dtype, in which case its data has to be copied.
+ */
+RAI_Tensor* RAI_TensorCreateFromString(DLDataType dtype, long long* dims, int ndims, RedisModuleString* blob);
+
 /**
  * Allocate the memory for a new Tensor and copy data fom a tensor to it.
  * @param t Source tensor to copy.
@@ -37,8 +76,55 @@ RAI_Tensor* RAI_TensorCreateWithDLDataType(DLDataType dtype, long long* dims, in
  */
 int RAI_TensorCopyTensor(RAI_Tensor* t, RAI_Tensor** dest);
 RAI_Tensor* RAI_TensorCreateFromDLTensor(DLManagedTensor* dl_tensor);
+
+/**
+ * Allocate a new Tensor holding tensors concatenated along dimension 0. The
+ * data is only copied when it has to be: a single tensor is returned as a
+ * shallow copy, and tensors that follow each other in the buffer of the same
+ * parent are returned as a view spanning them.
+ * @param ts Tensors of the same type and inner dimensions.
+ * @param n Number of tensors.
+ * @return the concatenated tensor, or NULL if n is 0
+ */
 RAI_Tensor* RAI_TensorCreateByConcatenatingTensors(RAI_Tensor** ts, long long n);
+
+/**
+ * Allocate a new Tensor viewing a slice of a tensor along dimension 0,
+ * without copying its data. The view holds a reference on the tensor, or on
+ * the tensor's own parent if it is a view itself, until it is freed.
+ * @param t Source tensor.
+ * @param offset Index of the first sample of the slice in dimension 0.
+ * @param len Number of samples in the slice.
+ * @return the view
+ */
 RAI_Tensor* RAI_TensorCreateBySlicingTensor(RAI_Tensor* t, long long offset, long long len);
+
+/**
+ * Copy the data of a view into a buffer of its own when its parent is much
+ * larger than what its views still reference, so that a view kept in a key
+ * does not keep a whole batch alive. Does nothing if t is not a view or is
+ * held by anyone else.
+ * @param t Tensor, typically just read from a key.
+ */
+void RAI_TensorCompactView(RAI_Tensor* t);
+
+/**
+ * Allocate a new Tensor holding the data of a tensor padded along dimension 1.
+ * @param t Source tensor, with at least 2 dimensions.
+ * @param len Length of dimension 1 in the new tensor, not smaller than t's.
+ * @param value Value of the padding elements, converted to t's data type.
+ * @return the padded tensor
+ */
+RAI_Tensor* RAI_TensorCreateByPadding(RAI_Tensor* t, long long len, double value);
+
+/**
+ * Allocate a new Tensor holding the data of a tensor truncated along
+ * dimension 1, undoing RAI_TensorCreateByPadding.
+ * @param t Source tensor, with at least 2 dimensions.
+ * @param len Length of dimension 1 in the new tensor, not larger than t's.
+ * @return the truncated tensor
+ */
+RAI_Tensor* RAI_TensorCreateByNarrowing(RAI_Tensor* t, long long len);
 size_t RAI_TensorLength(RAI_Tensor* t);
 size_t RAI_TensorDataSize(RAI_Tensor* t);
 size_t RAI_TensorDataSizeFromDLDataType(DLDataType dtype);
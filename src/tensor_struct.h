@@ -1,12 +1,15 @@
 #ifndef SRC_TENSOR_STRUCT_H_
 #define SRC_TENSOR_STRUCT_H_
 
+#include <stdatomic.h>
+
 #include "config.h"
 #include "dlpack/dlpack.h"
 
 typedef struct RAI_Tensor {
   DLManagedTensor tensor;
-  long long refCount;
+  // atomic, since views take references on their parent from any thread
+  atomic_llong refCount;
 } RAI_Tensor;
 
 #endif /* SRC_TENSOR_STRUCT_H_ */
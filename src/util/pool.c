@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "pool.h"
+#include "redismodule.h"
+
+/* Header in front of every block. It keeps the body aligned like malloc. */
+typedef union poolHeader {
+  size_t cls;
+  max_align_t align;
+} poolHeader;
+
+/* Class of the blocks too large for the pool */
+#define POOL_CLASS_NONE POOL_NUM_CLASSES
+
+/* A free block reuses its body as the links of the cache and depot lists */
+typedef struct poolFreeBlock {
+  poolHeader header;
+  struct poolFreeBlock *next;
+  /* set on the first block of a batch in the depot */
+  struct poolFreeBlock *next_batch;
+} poolFreeBlock;
+
+typedef struct poolCache {
+  poolFreeBlock *head[POOL_NUM_CLASSES];
+  size_t len[POOL_NUM_CLASSES];
+} poolCache;
+
+static struct {
+  pthread_once_t once;
+  pthread_key_t key;
+  pthread_mutex_t mutex;
+  poolFreeBlock *batches[POOL_NUM_CLASSES];
+  size_t nbatches[POOL_NUM_CLASSES];
+} pool_depot = {.once = PTHREAD_ONCE_INIT, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static __thread poolCache *pool_cache = NULL;
+
+static void poolFreeList(poolFreeBlock *block) {
+  while (block) {
+    poolFreeBlock *next = block->next;
+    RedisModule_Free(block);
+    block = next;
+  }
+}
+
+/* Gives the blocks cached by an exiting thread back to the allocator */
+static void poolCacheRelease(void *arg) {
+  poolCache *cache = arg;
+  for (size_t cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+    poolFreeList(cache->head[cls]);
+  }
+  RedisModule_Free(cache);
+}
+
+static void poolInit(void) {
+  pthread_key_create(&pool_depot.key, poolCacheRelease);
+}
+
+static poolCache *poolGetCache(void) {
+  if (pool_cache == NULL) {
+    pthread_once(&pool_depot.once, poolInit);
+    pool_cache = RedisModule_Calloc(1, sizeof(*pool_cache));
+    pthread_setspecific(pool_depot.key, pool_cache);
+  }
+  return pool_cache;
+}
+
+static size_t poolClass(size_t size) {
+  const size_t total = size + sizeof(poolHeader);
+  size_t cls = 0;
+  while (cls < POOL_NUM_CLASSES &&
+         ((size_t)1 << (POOL_MIN_CLASS_SHIFT + cls)) < total) {
+    cls++;
+  }
+  return cls;
+}
+
+/* Moves a batch of blocks from the depot to an empty thread cache */
+static void poolRefill(poolCache *cache, size_t cls) {
+  pthread_mutex_lock(&pool_depot.mutex);
+  poolFreeBlock *batch = pool_depot.batches[cls];
+  if (batch) {
+    pool_depot.batches[cls] = batch->next_batch;
+    pool_depot.nbatches[cls]--;
+  }
+  pthread_mutex_unlock(&pool_depot.mutex);
+
+  if (batch) {
+    cache->head[cls] = batch;
+    cache->len[cls] = POOL_BATCH;
+  }
+}
+
+/* Moves a batch of blocks from a full thread cache to the depot, or back to
+ * the allocator if the depot is full as well */
+static void poolFlush(poolCache *cache, size_t cls) {
+  poolFreeBlock *batch = cache->head[cls];
+  poolFreeBlock *last = batch;
+  for (size_t i = 1; i < POOL_BATCH; i++) {
+    last = last->next;
+  }
+  cache->head[cls] = last->next;
+  cache->len[cls] -= POOL_BATCH;
+  last->next = NULL;
+
+  pthread_mutex_lock(&pool_depot.mutex);
+  if (pool_depot.nbatches[cls] < POOL_DEPOT_BATCHES) {
+    batch->next_batch = pool_depot.batches[cls];
+    pool_depot.batches[cls] = batch;
+    pool_depot.nbatches[cls]++;
+    batch = NULL;
+  }
+  pthread_mutex_unlock(&pool_depot.mutex);
+
+  poolFreeList(batch);
+}
+
+void *poolAlloc(size_t size) {
+  const size_t cls = poolClass(size);
+  poolHeader *block = NULL;
+
+  if (cls == POOL_CLASS_NONE) {
+    block = RedisModule_Alloc(sizeof(poolHeader) + size);
+  } else {
+    poolCache *cache = poolGetCache();
+    if (cache->head[cls] == NULL) {
+      poolRefill(cache, cls);
+    }
+    if (cache->head[cls]) {
+      block = &cache->head[cls]->header;
+      cache->head[cls] = cache->head[cls]->next;
+      cache->len[cls]--;
+    } else {
+      block = RedisModule_Alloc((size_t)1 << (POOL_MIN_CLASS_SHIFT + cls));
+    }
+  }
+
+  if (block == NULL) {
+    return NULL;
+  }
+  block->cls = cls;
+  return block + 1;
+}
+
+void *poolCalloc(size_t size) {
+  void *ptr = poolAlloc(size);
+  if (ptr) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+void poolFree(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  poolHeader *header = (poolHeader *)ptr - 1;
+  const size_t cls = header->cls;
+  if (cls == POOL_CLASS_NONE) {
+    RedisModule_Free(header);
+    return;
+  }
+
+  poolCache *cache = poolGetCache();
+  poolFreeBlock *block = (poolFreeBlock *)header;
+  block->next = cache->head[cls];
+  cache->head[cls] = block;
+  cache->len[cls]++;
+  if (cache->len[cls] >= 2 * POOL_BATCH) {
+    poolFlush(cache, cls);
+  }
+}
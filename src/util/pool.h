@@ -0,0 +1,51 @@
+#include <stddef.h>
+
+#ifndef __POOL_H
+#define __POOL_H
+
+/*
+ * Size-class pool for small, short lived allocations such as tensors.
+ *
+ * Requests are rounded up to a power of two size class, from 64 bytes to
+ * 16 KB. Freed blocks are kept in a cache owned by the freeing thread and
+ * handed out again by the next allocation of the same class on that thread,
+ * so that the hot path never calls the allocator. A thread whose cache
+ * overflows moves a batch of blocks to a shared depot, where a thread whose
+ * cache is empty picks them up: blocks allocated by one thread and freed by
+ * another, like the outputs of a run, circulate instead of piling up.
+ *
+ * Larger requests go straight to the allocator. Every block starts with a
+ * header telling its class, so poolFree needs no size.
+ */
+
+#define POOL_MIN_CLASS_SHIFT 6
+#define POOL_NUM_CLASSES 9
+/* Number of blocks moved between a thread cache and the depot at once */
+#define POOL_BATCH 16
+/* Maximum number of batches of each class kept in the depot */
+#define POOL_DEPOT_BATCHES 8
+
+/**
+ * Allocates a block of at least `size` bytes, aligned like malloc.
+ *
+ * @param size
+ * @return the block, or NULL on allocation failure
+ */
+void *poolAlloc(size_t size);
+
+/**
+ * Allocates a zeroed block of at least `size` bytes, aligned like malloc.
+ *
+ * @param size
+ * @return the block, or NULL on allocation failure
+ */
+void *poolCalloc(size_t size);
+
+/**
+ * Frees a block returned by poolAlloc or poolCalloc, from any thread.
+ *
+ * @param ptr block to free, may be NULL
+ */
+void poolFree(void *ptr);
+
+#endif /* __POOL_H */
@@ -1,4 +1,5 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -6,86 +7,100 @@
 #include "../redisai_memory.h"
 #include "redismodule.h"
 
-queue *queueCreate(void) {
+queue *queueCreate(size_t capacity) {
   struct queue *queue;
 
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
   if ((queue = RedisModule_Calloc(1, sizeof(*queue))) == NULL) return NULL;
+  if ((queue->cells = RedisModule_Calloc(size, sizeof(queueCell))) == NULL) {
+    RedisModule_Free(queue);
+    return NULL;
+  }
 
-  queue->front = queue->back = NULL;
-  queue->len = 0;
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+    queue->cells[i].value = NULL;
+  }
+  queue->mask = size - 1;
   queue->free = NULL;
+  atomic_init(&queue->enqueue_pos, 0);
+  atomic_init(&queue->dequeue_pos, 0);
   return queue;
 }
 
-void queuePush(queue *queue, void *value) {
-  queueItem *item;
-
-  if ((item = RedisModule_Calloc(1, sizeof(*item))) == NULL) return;
-  item->value = value;
-  item->next = NULL;
-  item->prev = NULL;
+int queuePush(queue *queue, void *value) {
+  queueCell *cell;
+  size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
 
-  if (queue->len == 0) {
-    queue->front = queue->back = item;
-  } else {
-    queue->back->next = item;
-    item->prev = queue->back;
-    queue->back = item;
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak(&queue->enqueue_pos, &pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* The cell still holds a value from the previous lap: full */
+      return 0;
+    } else {
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    }
   }
-  queue->len++;
-}
 
-queueItem *queuePop(queue *queue) {
-  queueItem *item = queue->front;
-  if (item == NULL) {
-    return NULL;
-  }
-  queue->front = item->next;
-  if (queue->front != NULL) {
-    queue->front->prev = NULL;
-  }
-  if (item == queue->back) {
-    queue->back = NULL;
-  }
-  item->next = NULL;
-  item->prev = NULL;
-  queue->len--;
-  return item;
+  cell->value = value;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+  return 1;
 }
 
-queueItem *queueFront(queue *queue) { return queue->front; }
-
-queueItem *queueNext(queueItem *item) { return item->next; }
+void *queuePop(queue *queue) {
+  queueCell *cell;
+  size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
 
-queueItem *queueEvict(queue *queue, queueItem *item) {
-  if (item == queue->front) {
-    return queuePop(queue);
-  } else if (item == queue->back) {
-    queue->back = item->prev;
-    queue->back->next = NULL;
-  } else {
-    item->prev->next = item->next;
-    item->next->prev = item->prev;
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak(&queue->dequeue_pos, &pos, pos + 1)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* The cell has not been published yet: empty */
+      return NULL;
+    } else {
+      pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    }
   }
 
-  item->next = NULL;
-  item->prev = NULL;
-  queue->len--;
-  return item;
+  void *value = cell->value;
+  cell->value = NULL;
+  atomic_store_explicit(&cell->sequence, pos + queue->mask + 1,
+                        memory_order_release);
+  return value;
+}
+
+long long queueLength(queue *queue) {
+  size_t dequeue_pos = atomic_load(&queue->dequeue_pos);
+  size_t enqueue_pos = atomic_load(&queue->enqueue_pos);
+  if (enqueue_pos <= dequeue_pos) {
+    return 0;
+  }
+  return (long long)(enqueue_pos - dequeue_pos);
 }
 
-long long queueLength(queue *queue) { return queue->len; }
+size_t queueCapacity(queue *queue) { return queue->mask + 1; }
 
 void queueRelease(queue *queue) {
-  unsigned long len;
-  queueItem *current;
+  void *value;
 
-  len = queue->len;
-  while (len--) {
-    current = queuePop(queue);
-    if (current && queue->free) queue->free(current->value);
-    RedisModule_Free(current);
+  while ((value = queuePop(queue)) != NULL) {
+    if (queue->free) queue->free(value);
   }
-  queue->front = queue->back = NULL;
-  queue->len = 0;
+  RedisModule_Free(queue->cells);
+  RedisModule_Free(queue);
 }
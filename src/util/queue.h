@@ -1,5 +1,5 @@
-
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -9,26 +9,81 @@
 #ifndef __QUEUE_H
 #define __QUEUE_H
 
-typedef struct queueItem {
-  struct queueItem *next;
-  struct queueItem *prev;
+/*
+ * Bounded multi-producer multi-consumer lock-free queue.
+ *
+ * The queue is a ring of pre-allocated cells, each carrying a sequence number
+ * that tells producers and consumers whether the cell is free to be written or
+ * ready to be read (D. Vyukov's bounded MPMC queue). Pushing and popping never
+ * allocate and never take a lock: a producer claims a slot with a single CAS on
+ * the enqueue position, a consumer with a single CAS on the dequeue position.
+ */
+
+#define QUEUE_CACHELINE_SIZE 64
+
+typedef struct queueCell {
+  atomic_size_t sequence;
   void *value;
-} queueItem;
+} queueCell;
 
 typedef struct queue {
-  queueItem *front;
-  queueItem *back;
+  queueCell *cells;
+  size_t mask;
   void (*free)(void *ptr);
-  unsigned long len;
+  char pad0[QUEUE_CACHELINE_SIZE];
+  atomic_size_t enqueue_pos;
+  char pad1[QUEUE_CACHELINE_SIZE];
+  atomic_size_t dequeue_pos;
+  char pad2[QUEUE_CACHELINE_SIZE];
 } queue;
 
-queue *queueCreate(void);
-void queuePush(queue *queue, void *value);
-queueItem *queuePop(queue *queue);
-queueItem *queueFront(queue *queue);
-queueItem *queueNext(queueItem *item);
-queueItem *queueEvict(queue *queue, queueItem *item);
+/**
+ * Allocates a queue able to hold at least `capacity` items. The capacity is
+ * rounded up to the next power of two and the cells are allocated upfront.
+ *
+ * @param capacity minimum number of items the queue can hold
+ * @return the queue, or NULL on allocation failure
+ */
+queue *queueCreate(size_t capacity);
+
+/**
+ * Appends a value at the back of the queue. Safe to call concurrently from
+ * any number of threads.
+ *
+ * @param queue
+ * @param value
+ * @return 1 if the value was pushed, 0 if the queue is full
+ */
+int queuePush(queue *queue, void *value);
+
+/**
+ * Removes the value at the front of the queue. Safe to call concurrently from
+ * any number of threads.
+ *
+ * @param queue
+ * @return the value, or NULL if the queue is empty
+ */
+void *queuePop(queue *queue);
+
+/**
+ * @param queue
+ * @return number of items in the queue. The value is a snapshot and may be
+ * stale by the time it is returned when other threads push or pop.
+ */
 long long queueLength(queue *queue);
+
+/**
+ * @param queue
+ * @return maximum number of items the queue can hold
+ */
+size_t queueCapacity(queue *queue);
+
+/**
+ * Frees the queue. If a free callback is set, it is called on every value
+ * still in the queue. Must not be called concurrently with other operations.
+ *
+ * @param queue
+ */
 void queueRelease(queue *queue);
 
-#endif /* __QUEUE_H */
\ No newline at end of file
+#endif /* __QUEUE_H */
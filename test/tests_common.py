@@ -281,6 +281,57 @@ def test_common_tensorset_multiproc_blob(env):
     env.debugPrint("AI.TENSORSET elapsed time(sec) {:6.2f}\tAvg. ops/sec {:10.2f}".format(elapsed_time, avg_ops_sec), True)
 
 
+def test_common_tensorset_large_blob(env):
+    con = env.getConnection()
+
+    # large blobs are kept by the tensor instead of copied when aligned and
+    # the server can trim them, and copied otherwise
+    for datatype, nbytes in [("UINT8", 1), ("INT8", 1), ("FLOAT", 4)]:
+        blob = bytes(range(256)) * 4096
+        shape = [1, 1024, 1024 // nbytes]
+        ret = con.execute_command('AI.TENSORSET', 'tensor_a', datatype, *shape, 'BLOB', blob)
+        env.assertEqual(ret, b'OK')
+        ret = con.execute_command('AI.TENSORSET', 'tensor_b', datatype, *shape, 'BLOB', blob)
+        env.assertEqual(ret, b'OK')
+
+        ensureSlaveSynced(con, env)
+
+        env.assertEqual(con.execute_command('AI.TENSORGET', 'tensor_a', 'BLOB')[2], blob)
+        con.execute_command('DEL', 'tensor_a')
+        env.assertEqual(con.execute_command('AI.TENSORGET', 'tensor_b', 'BLOB')[2], blob)
+        con.execute_command('DEL', 'tensor_b')
+
+
+def test_common_tensorset_blob_no_copy(env):
+    # the replica and the AOF hold copies of the command of their own
+    if env.useSlaves or env.useAof:
+        return
+
+    con = env.getConnection()
+
+    # the blob is only kept by servers that can trim it, since Redis 7
+    redis_version = con.info('server')['redis_version']
+    if int(redis_version.split('.')[0]) < 7:
+        env.debugPrint("skipping {} on Redis {}".format(sys._getframe().f_code.co_name, redis_version), force=True)
+        return
+
+    size = 16 * 1024 * 1024
+    blob = bytes(range(256)) * (size // 256)
+
+    con.execute_command('CONFIG', 'RESETSTAT')
+    used_memory = con.info('memory')['used_memory']
+    ret = con.execute_command('AI.TENSORSET', 'tensor', 'UINT8', size, 'BLOB', blob)
+    env.assertEqual(ret, b'OK')
+
+    # the peak is sampled once the command returns, while the client still
+    # holds its arguments: a copy of the blob would double it
+    peak_memory = con.info('memory')['used_memory_peak']
+    env.assertTrue(peak_memory - used_memory < size * 3 // 2)
+
+    env.assertEqual(con.execute_command('AI.TENSORGET', 'tensor', 'BLOB')[2], blob)
+    con.execute_command('DEL', 'tensor')
+
+
 def test_tensorset_disconnect(env):
     red = env.getConnection()
     ret = send_and_disconnect(('AI.TENSORSET', 't_FLOAT', 'FLOAT', 2, 'VALUES', 2, 3), red)
@@ -293,3 +344,77 @@ def test_tensorget_disconnect(env):
     env.assertEqual(ret, b'OK')
     ret = send_and_disconnect(('AI.TENSORGET', 't_FLOAT'), red)
     env.assertEqual(ret, None)
+
+
+def test_common_config_max_queue(env):
+    con = env.getConnection()
+
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_LENGTH', 100)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_WAIT', 50)
+    env.assertEqual(ret, b'OK')
+
+    try:
+        con.execute_command('AI.CONFIG', 'MAX_QUEUE_LENGTH', -1)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("error setting MAX_QUEUE_LENGTH", exception.__str__())
+
+    try:
+        con.execute_command('AI.CONFIG', 'MAX_QUEUE_WAIT', 'forever')
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("error setting MAX_QUEUE_WAIT", exception.__str__())
+
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_LENGTH', 0)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_WAIT', 0)
+    env.assertEqual(ret, b'OK')
+
+
+def test_common_config_work_stealing(env):
+    con = env.getConnection()
+
+    ret = con.execute_command('AI.CONFIG', 'WORK_STEALING', 8)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.CONFIG', 'WORK_STEALING', 'CPU:1', 2)
+    env.assertEqual(ret, b'OK')
+
+    try:
+        con.execute_command('AI.CONFIG', 'WORK_STEALING', -1)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("error setting WORK_STEALING", exception.__str__())
+
+    try:
+        con.execute_command('AI.CONFIG', 'WORK_STEALING', 'GPU:0', 2)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("WORK_STEALING is only supported on CPU devices", exception.__str__())
+
+    ret = con.execute_command('AI.CONFIG', 'WORK_STEALING', 0)
+    env.assertEqual(ret, b'OK')
+
+
+def test_common_config_threads_per_queue(env):
+    con = env.getConnection()
+
+    ret = con.execute_command('AI.CONFIG', 'THREADS_PER_QUEUE', 'CPU', 4)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.CONFIG', 'THREADS_PER_QUEUE', 'CPU', 1)
+    env.assertEqual(ret, b'OK')
+
+    try:
+        con.execute_command('AI.CONFIG', 'THREADS_PER_QUEUE', 'CPU', 0)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("error setting THREADS_PER_QUEUE", exception.__str__())
+
+    # the pool is still usable after being resized
+    ret = con.execute_command('AI.DAGRUN', '|>', 'AI.TENSORSET', 'a', 'FLOAT', 2, 'VALUES', 2, 3)
+    env.assertEqual(ret, [b'OK'])
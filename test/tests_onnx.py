@@ -198,6 +198,708 @@ def test_onnx_modelrun_mnist_autobatch(env):
 
     env.assertEqual(argmax, 1)
 
+    # b and d are views of the same batched output, d outlives b
+    con.execute_command('DEL', 'b')
+    tensor = con.execute_command('AI.TENSORGET', 'd', 'VALUES')
+    values = tensor[-1]
+    argmax = max(range(len(values)), key=lambda i: values[i])
+
+    env.assertEqual(argmax, 1)
+
+
+def test_onnx_modelrun_mnist_coalesce(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+    con.execute_command('AI.TENSORSET', 'c', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    def run(output):
+        con = env.getConnection()
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', output)
+
+    threads = [threading.Thread(target=run, args=(output,)) for output in ['b1', 'b2']]
+    for t in threads:
+        t.start()
+
+    # both requests on 'a' share a single slot, so MINBATCHSIZE is not reached
+    import time
+    time.sleep(1)
+    env.assertEqual(con.execute_command('EXISTS', 'b1', 'b2'), 0)
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'c', 'OUTPUTS', 'd')
+    for t in threads:
+        t.join()
+
+    ensureSlaveSynced(con, env)
+
+    for output in ['b1', 'b2', 'd']:
+        values = con.execute_command('AI.TENSORGET', output, 'VALUES')[-1]
+        argmax = max(range(len(values)), key=lambda i: float(values[i]))
+        env.assertEqual(argmax, 1)
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CALLS'], 3)
+    # ONNX runs on the tensors' data in place
+    env.assertEqual(info_dict['FALLBACKCOPIES'], 0)
+
+
+def test_onnx_modelrun_mnist_cache(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    # room for a single run: 1x1x28x28 float input and 1x10 float output
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'CACHE', 4000, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+    con.execute_command('AI.TENSORSET', 'c', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+    con.execute_command('AI.TENSORSET', 'z', 'FLOAT', 1, 1, 28, 28, 'BLOB', bytes(len(sample_raw)))
+
+    ensureSlaveSynced(con, env)
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b1')
+    # same content under another key
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'c', 'OUTPUTS', 'b2')
+
+    ensureSlaveSynced(con, env)
+
+    env.assertEqual(con.execute_command('AI.TENSORGET', 'b1', 'BLOB'),
+                    con.execute_command('AI.TENSORGET', 'b2', 'BLOB'))
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CALLS'], 2)
+    env.assertEqual(info_dict['CACHEHITS'], 1)
+    env.assertEqual(info_dict['CACHEMISSES'], 1)
+    env.assertEqual(info_dict['CACHEEVICTIONS'], 0)
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'z', 'OUTPUTS', 'b3')
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CACHEMISSES'], 2)
+    env.assertEqual(info_dict['CACHEEVICTIONS'], 1)
+
+    # overwriting the model starts from an empty cache
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'CACHE', 4000, model_pb)
+    env.assertEqual(ret, b'OK')
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'z', 'OUTPUTS', 'b3')
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CACHEHITS'], 0)
+    env.assertEqual(info_dict['CACHEMISSES'], 1)
+
+
+def test_onnx_modelrun_mnist_weight(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'WEIGHT', 0, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for WEIGHT", exception.__str__())
+
+    # weights past the maximum would overflow the time granted per round
+    for weight in [1000001, 2 ** 61]:
+        exception = None
+        try:
+            con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'WEIGHT', weight, model_pb)
+        except Exception as e:
+            exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for WEIGHT", exception.__str__())
+
+        exception = None
+        try:
+            con.execute_command('AI.CONFIG', 'WEIGHT', 'm', weight)
+        except Exception as e:
+            exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("error setting WEIGHT", exception.__str__())
+
+    # m1 and m2 share the tenant of their tag, m3 is a tenant on its own
+    ret = con.execute_command('AI.MODELSET', 'm1', 'ONNX', DEVICE, 'TAG', 'team-a', 'WEIGHT', 3, model_pb)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.MODELSET', 'm2', 'ONNX', DEVICE, 'TAG', 'team-a', 'WEIGHT', 3, model_pb)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.MODELSET', 'm3', 'ONNX', DEVICE, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    for key in ['m1', 'm2', 'm3']:
+        con.execute_command('AI.MODELRUN', key, 'INPUTS', 'a', 'OUTPUTS', 'b')
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm1'))
+    env.assertEqual(info_dict['TENANT'], 'team-a')
+    env.assertEqual(info_dict['WEIGHT'], 3)
+    env.assertEqual(info_dict['TENANTCALLS'], 2)
+    env.assertTrue(info_dict['TENANTQUEUEWAIT'] >= info_dict['QUEUEWAIT'])
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm3'))
+    env.assertEqual(info_dict['TENANT'], 'm3')
+    env.assertEqual(info_dict['WEIGHT'], 1)
+    env.assertEqual(info_dict['TENANTCALLS'], 1)
+
+    # a tenant weighs as much as the heaviest of its models, whichever runs
+    ret = con.execute_command('AI.MODELSET', 'm4', 'ONNX', DEVICE, 'TAG', 'team-a', 'WEIGHT', 7, model_pb)
+    env.assertEqual(ret, b'OK')
+    for key in ['m4', 'm1']:
+        con.execute_command('AI.MODELRUN', key, 'INPUTS', 'a', 'OUTPUTS', 'b')
+        info_dict = info_to_dict(con.execute_command('AI.INFO', 'm1'))
+        env.assertEqual(info_dict['WEIGHT'], 7)
+
+    con.execute_command('DEL', 'm4')
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm1'))
+    env.assertEqual(info_dict['WEIGHT'], 3)
+
+    ret = con.execute_command('AI.CONFIG', 'WEIGHT', 'm3', 5)
+    env.assertEqual(ret, b'OK')
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm3'))
+    env.assertEqual(info_dict['WEIGHT'], 5)
+
+    ret = con.execute_command('AI.CONFIG', 'WEIGHT', 'm3', 0)
+    env.assertEqual(ret, b'OK')
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm3'))
+    env.assertEqual(info_dict['WEIGHT'], 1)
+
+
+def test_onnx_modelrun_mnist_maxruntime(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'MAXRUNTIME', -1, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for MAXRUNTIME", exception.__str__())
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'MAXRUNTIME', 60000, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+
+    ensureSlaveSynced(con, env)
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    values = tensor[-1]
+    argmax = max(range(len(values)), key=lambda i: values[i])
+    env.assertEqual(argmax, 1)
+
+    # a batch of a thousand images cannot run within a millisecond
+    with open(os.path.join(test_data_path, 'mnist_batched.onnx'), 'rb') as f:
+        batched_model_pb = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm_slow', 'ONNX', DEVICE, 'MAXRUNTIME', 1, batched_model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'many', 'FLOAT', 1000, 1, 28, 28, 'BLOB', sample_raw * 1000)
+
+    ensureSlaveSynced(con, env)
+
+    exception = None
+    try:
+        con.execute_command('AI.MODELRUN', 'm_slow', 'INPUTS', 'many', 'OUTPUTS', 'c')
+    except Exception as e:
+        exception = e
+    env.assertEqual(type(exception), redis.exceptions.ResponseError)
+    env.assertEqual("Model run exceeded MAXRUNTIME", exception.__str__())
+    env.assertEqual(con.execute_command('EXISTS', 'c'), 0)
+
+
+def test_onnx_modelrun_mnist_autobatch_timeout(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                            'BATCHTIMEOUT', 10, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("BATCHTIMEOUT specified without BATCHSIZE", exception.__str__())
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2,
+                              'BATCHTIMEOUT', 100, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    # MINBATCHSIZE is never reached, the lone request is flushed on timeout
+    ret = con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    env.assertEqual(ret, b'OK')
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    values = tensor[-1]
+    argmax = max(range(len(values)), key=lambda i: values[i])
+
+    env.assertEqual(argmax, 1)
+
+
+def test_onnx_modelrun_mnist_autobatch_targetlatency(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                            'TARGETLATENCY', 10, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("TARGETLATENCY specified without BATCHSIZE", exception.__str__())
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                            'BATCHSIZE', 4, 'MINBATCHSIZE', 2, 'TARGETLATENCY', 10, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("TARGETLATENCY cannot be combined with MINBATCHSIZE or BATCHTIMEOUT", exception.__str__())
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 4, 'TARGETLATENCY', 1000, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    for _ in range(10):
+        ret = con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+        env.assertEqual(ret, b'OK')
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    values = tensor[-1]
+    argmax = max(range(len(values)), key=lambda i: values[i])
+    env.assertEqual(argmax, 1)
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertTrue(len(info_dict['BATCHCURVE']) > 0)
+    env.assertEqual(info_dict['BATCHCURVE'][0][0], 1)
+    env.assertTrue(info_dict['TARGETBATCHSIZE'] >= 1)
+    env.assertTrue(info_dict['TARGETBATCHSIZE'] <= 4)
+
+
+def test_onnx_modelrun_mnist_autobatch_padbuckets(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                            'PADBUCKETS', 32, 64, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("PADBUCKETS specified without BATCHSIZE", exception.__str__())
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                            'BATCHSIZE', 2, 'PADBUCKETS', 64, 32, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for PADBUCKETS", exception.__str__())
+
+    # the image is never padded: both requests have the same size
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2,
+                              'PADBUCKETS', 1, 28, 'PADVALUE', 0, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    def run():
+        con = env.getConnection()
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'c')
+
+    t = threading.Thread(target=run)
+    t.start()
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    t.join()
+
+    ensureSlaveSynced(con, env)
+
+    for out in ['b', 'c']:
+        tensor = con.execute_command('AI.TENSORGET', out, 'VALUES')
+        values = tensor[-1]
+        argmax = max(range(len(values)), key=lambda i: values[i])
+        env.assertEqual(argmax, 1)
+
+
+def test_onnx_modelrun_mnist_invalid_inputs(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'BATCHSIZE', 4, 'MINBATCHSIZE', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+    con.execute_command('AI.TENSORSET', 'wrong_shape', 'FLOAT', 1, 1, 28, 27, 'BLOB', sample_raw[:28 * 27 * 4])
+    con.execute_command('AI.TENSORSET', 'wrong_type', 'INT32', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    # malformed inputs are rejected before they get queued
+    try:
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'wrong_shape', 'OUTPUTS', 'b')
+    except Exception as e:
+        exception = e
+    env.assertEqual(type(exception), redis.exceptions.ResponseError)
+    env.assertEqual("Input 0 has size 27 in dimension 3, expected 28", exception.__str__())
+
+    try:
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'wrong_type', 'OUTPUTS', 'b')
+    except Exception as e:
+        exception = e
+    env.assertEqual(type(exception), redis.exceptions.ResponseError)
+    env.assertEqual("Input 0 has the wrong type", exception.__str__())
+
+    # and do not count towards MINBATCHSIZE
+    def run():
+        con = env.getConnection()
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'c')
+
+    t = threading.Thread(target=run)
+    t.start()
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    t.join()
+
+    ensureSlaveSynced(con, env)
+
+    values = con.execute_command('AI.TENSORGET', 'b', 'VALUES')[-1]
+    argmax = max(range(len(values)), key=lambda i: float(values[i]))
+    env.assertEqual(argmax, 1)
+
+
+def test_onnx_modelrun_mnist_autobatch_split(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, 'BATCHSIZE', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    # 5 samples are run as 3 chunks of at most 2 samples
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 5, 1, 28, 28, 'BLOB', sample_raw * 5)
+
+    ensureSlaveSynced(con, env)
+
+    ret = con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    env.assertEqual(ret, b'OK')
+
+    ensureSlaveSynced(con, env)
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    env.assertEqual(tensor[1], [5, 10])
+    values = tensor[-1]
+    for sample in range(5):
+        sample_values = values[sample * 10:(sample + 1) * 10]
+        argmax = max(range(10), key=lambda i: float(sample_values[i]))
+        env.assertEqual(argmax, 1)
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CALLS'], 1)
+    env.assertEqual(info_dict['SAMPLES'], 5)
+
+
+def test_onnx_modelrun_mnist_priority_timeout(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    try:
+        con.execute_command('AI.MODELRUN', 'm', 'PRIORITY', 'high', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for PRIORITY", exception.__str__())
+
+    try:
+        con.execute_command('AI.MODELRUN', 'm', 'TIMEOUT', 0, 'INPUTS', 'a', 'OUTPUTS', 'b')
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for TIMEOUT", exception.__str__())
+
+    ret = con.execute_command('AI.MODELRUN', 'm', 'PRIORITY', 10, 'TIMEOUT', 60000,
+                              'INPUTS', 'a', 'OUTPUTS', 'b')
+    env.assertEqual(ret, b'OK')
+
+    ensureSlaveSynced(con, env)
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    values = tensor[-1]
+    argmax = max(range(len(values)), key=lambda i: values[i])
+
+    env.assertEqual(argmax, 1)
+
+    # a batch of two samples is held until it is complete
+    with open(os.path.join(test_data_path, 'mnist_batched.onnx'), 'rb') as f:
+        batched_model_pb = f.read()
+
+    ret = con.execute_command('AI.MODELSET', 'm_batched', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2, batched_model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a2', 'FLOAT', 2, 1, 28, 28, 'BLOB', sample_raw * 2)
+
+    ensureSlaveSynced(con, env)
+
+    # a request held past its TIMEOUT is dropped
+    exception = None
+    try:
+        con.execute_command('AI.MODELRUN', 'm_batched', 'TIMEOUT', 100,
+                            'INPUTS', 'a', 'OUTPUTS', 'expired')
+    except Exception as e:
+        exception = e
+    env.assertEqual(type(exception), redis.exceptions.ResponseError)
+    env.assertEqual("Timed out while waiting in the run queue", exception.__str__())
+    env.assertEqual(con.execute_command('EXISTS', 'expired'), 0)
+
+    # a request of higher PRIORITY overtakes the one held in the queue: it
+    # fills a batch on its own, and the held request keeps waiting
+    def run():
+        con = env.getConnection()
+        con.execute_command('AI.MODELRUN', 'm_batched', 'INPUTS', 'a', 'OUTPUTS', 'low')
+
+    t = threading.Thread(target=run)
+    t.start()
+
+    time.sleep(1)
+
+    ret = con.execute_command('AI.MODELRUN', 'm_batched', 'PRIORITY', 10,
+                              'INPUTS', 'a2', 'OUTPUTS', 'high')
+    env.assertEqual(ret, b'OK')
+    env.assertTrue(t.is_alive())
+    env.assertEqual(con.execute_command('EXISTS', 'low'), 0)
+
+    con.execute_command('AI.MODELRUN', 'm_batched', 'INPUTS', 'a', 'OUTPUTS', 'c')
+    t.join()
+
+    ensureSlaveSynced(con, env)
+
+    env.assertEqual(con.execute_command('EXISTS', 'low'), 1)
+
+
+def test_onnx_modelrun_mnist_max_queue_length(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    # a single request is held in the queue until a second one completes the batch
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_LENGTH', 1)
+    env.assertEqual(ret, b'OK')
+
+    def run():
+        con = env.getConnection()
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+
+    t = threading.Thread(target=run)
+    t.start()
+
+    time.sleep(1)
+
+    exception = None
+    try:
+        con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'c')
+    except Exception as e:
+        exception = e
+    env.assertEqual(type(exception), redis.exceptions.ResponseError)
+    env.assertEqual("BUSY Run queue is full for device", exception.__str__())
+
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['REJECTED'], 1)
+    env.assertEqual(con.execute_command('EXISTS', 'c'), 0)
+
+    # once the limit is lifted the held request completes its batch
+    ret = con.execute_command('AI.CONFIG', 'MAX_QUEUE_LENGTH', 0)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'c')
+    t.join()
+
+    ensureSlaveSynced(con, env)
+
+    for out in ['b', 'c']:
+        tensor = con.execute_command('AI.TENSORGET', out, 'VALUES')
+        values = tensor[-1]
+        argmax = max(range(len(values)), key=lambda i: values[i])
+        env.assertEqual(argmax, 1)
+
 
 def test_onnx_modelrun_iris(env):
     if not TEST_ONNX:
@@ -286,6 +988,7 @@ def test_onnx_modelinfo(env):
         env.assertEqual(info_dict_0['SAMPLES'], call)
         env.assertEqual(info_dict_0['CALLS'], call)
         env.assertEqual(info_dict_0['ERRORS'], 0)
+        env.assertEqual(info_dict_0['REJECTED'], 0)
 
         previous_duration = info_dict_0['DURATION']
 
@@ -328,6 +1031,48 @@ def test_onnx_modelrun_disconnect(env):
     ret = send_and_disconnect(('AI.MODELRUN', 'linear', 'INPUTS', 'features', 'OUTPUTS', 'linear_out'), con)
     env.assertEqual(ret, None)
 
+
+def test_onnx_modelrun_disconnect_queued(env):
+    if not TEST_ONNX:
+        env.debugPrint("skipping {} since TEST_ONNX=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_batched.onnx')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    # a single request is held in the queue until a second one completes the batch
+    ret = con.execute_command('AI.MODELSET', 'm', 'ONNX', DEVICE,
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    ret = send_and_disconnect(('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'cancelled'), con)
+    env.assertEqual(ret, None)
+
+    time.sleep(1)
+
+    # the request of the client gone is dropped rather than batched
+    ret = con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b')
+    env.assertEqual(ret, b'OK')
+
+    ensureSlaveSynced(con, env)
+
+    env.assertEqual(con.execute_command('EXISTS', 'cancelled'), 0)
+    info_dict = info_to_dict(con.execute_command('AI.INFO', 'm'))
+    env.assertEqual(info_dict['CALLS'], 1)
+
 def test_onnx_model_rdb_save_load(env):
     env.skipOnCluster()
     if env.useAof or not TEST_ONNX:
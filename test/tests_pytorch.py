@@ -178,6 +178,78 @@ def test_pytorch_modelrun_autobatch(env):
     env.assertEqual(values, [b'4', b'6', b'4', b'6'])
 
 
+def test_pytorch_modelrun_autobatch_padbuckets(env):
+    if not TEST_PT:
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'pt-minimal.pt')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'TORCH', 'CPU',
+                            'BATCHSIZE', 2, 'PADBUCKETS', 4, 8, 'PADOUTPUTS', 1, 0, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for PADOUTPUTS", exception.__str__())
+
+    # only the outputs listed in PADOUTPUTS are narrowed back
+    ret = con.execute_command('AI.MODELSET', 'm', 'TORCH', 'CPU',
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2,
+                              'PADBUCKETS', 4, 8, 'PADVALUE', -1, 'PADOUTPUTS', 0, model_pb)
+    env.assertEqual(ret, b'OK')
+    ret = con.execute_command('AI.MODELSET', 'm_padded', 'TORCH', 'CPU',
+                              'BATCHSIZE', 2, 'MINBATCHSIZE', 2,
+                              'PADBUCKETS', 4, 8, 'PADVALUE', -1, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    # lengths 2 and 3 both fall in the bucket of length 4
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 2, 'VALUES', 1, 2)
+    con.execute_command('AI.TENSORSET', 'b', 'FLOAT', 1, 2, 'VALUES', 1, 2)
+
+    con.execute_command('AI.TENSORSET', 'd', 'FLOAT', 1, 3, 'VALUES', 1, 2, 3)
+    con.execute_command('AI.TENSORSET', 'e', 'FLOAT', 1, 3, 'VALUES', 1, 2, 3)
+
+    ensureSlaveSynced(con, env)
+
+    for model in ['m', 'm_padded']:
+        def run():
+            con = env.getConnection()
+            con.execute_command('AI.MODELRUN', model, 'INPUTS', 'd', 'e', 'OUTPUTS', 'f_' + model)
+            ensureSlaveSynced(con, env)
+
+        t = threading.Thread(target=run)
+        t.start()
+
+        con.execute_command('AI.MODELRUN', model, 'INPUTS', 'a', 'b', 'OUTPUTS', 'c_' + model)
+        t.join()
+
+    ensureSlaveSynced(con, env)
+
+    # each output is narrowed back to the length of its own request
+    tensor = con.execute_command('AI.TENSORGET', 'c_m', 'VALUES')
+    env.assertEqual(tensor[1], [1, 2])
+    env.assertEqual(tensor[-1], [b'2', b'4'])
+
+    tensor = con.execute_command('AI.TENSORGET', 'f_m', 'VALUES')
+    env.assertEqual(tensor[1], [1, 3])
+    env.assertEqual(tensor[-1], [b'2', b'4', b'6'])
+
+    # without PADOUTPUTS, an output of the bucket length is left as it is
+    tensor = con.execute_command('AI.TENSORGET', 'c_m_padded', 'VALUES')
+    env.assertEqual(tensor[1], [1, 4])
+    env.assertEqual(tensor[-1], [b'2', b'4', b'-2', b'-2'])
+
+    tensor = con.execute_command('AI.TENSORGET', 'f_m_padded', 'VALUES')
+    env.assertEqual(tensor[1], [1, 4])
+    env.assertEqual(tensor[-1], [b'2', b'4', b'6', b'-2'])
+
+
 def test_pytorch_modelinfo(env):
     if not TEST_PT:
         env.debugPrint("skipping {} since TEST_PT=0".format(sys._getframe().f_code.co_name), force=True)
@@ -361,4 +361,48 @@ def test_tflite_model_rdb_save_load(env):
     # Assert in memory model binary is equal to loaded model binary
     env.assertTrue(model_serialized_memory == model_serialized_after_rdbload)
     # Assert input model binary is equal to loaded model binary
-    env.assertTrue(model_pb == model_serialized_after_rdbload[7])
\ No newline at end of file
+    env.assertTrue(model_pb == model_serialized_after_rdbload[7])
+
+def test_run_tflite_model_sessions(env):
+    if not TEST_TFLITE:
+        env.debugPrint("skipping {} since TEST_TFLITE=0".format(sys._getframe().f_code.co_name), force=True)
+        return
+
+    con = env.getConnection()
+
+    test_data_path = os.path.join(os.path.dirname(__file__), 'test_data')
+    model_filename = os.path.join(test_data_path, 'mnist_model_quant.tflite')
+    sample_filename = os.path.join(test_data_path, 'one.raw')
+
+    with open(model_filename, 'rb') as f:
+        model_pb = f.read()
+
+    with open(sample_filename, 'rb') as f:
+        sample_raw = f.read()
+
+    try:
+        con.execute_command('AI.MODELSET', 'm', 'TFLITE', 'CPU', 'SESSIONS', 0, model_pb)
+    except Exception as e:
+        exception = e
+        env.assertEqual(type(exception), redis.exceptions.ResponseError)
+        env.assertEqual("Invalid argument for SESSIONS", exception.__str__())
+
+    ret = con.execute_command('AI.MODELSET', 'm', 'TFLITE', 'CPU', 'SESSIONS', 2, model_pb)
+    env.assertEqual(ret, b'OK')
+
+    con.execute_command('AI.TENSORSET', 'a', 'FLOAT', 1, 1, 28, 28, 'BLOB', sample_raw)
+
+    ensureSlaveSynced(con, env)
+
+    def run(con):
+        for _ in range(50):
+            con.execute_command('AI.MODELRUN', 'm', 'INPUTS', 'a', 'OUTPUTS', 'b', 'c')
+
+    run_test_multiproc(env, 4, run)
+
+    ensureSlaveSynced(con, env)
+
+    tensor = con.execute_command('AI.TENSORGET', 'b', 'VALUES')
+    value = tensor[-1][0]
+
+    env.assertEqual(value, 1)